@@ -1,4 +1,14 @@
 #include "matrix_operations.h"
+#include "intermediate_store.h"
+#include "summa_engine.h"
+#include "cannon_engine.h"
+#include "stream_pipeline.h"
+#include "task_scheduler.h"
+#include "node_memory.h"
+#include "rma_input.h"
+#include "matrix_file.h"
+#include "phase_timer.h"
+#include "result_verify.h"
 #include <mpi.h>
 
 int main(int argc, char **argv)
@@ -10,8 +20,9 @@ int main(int argc, char **argv)
     char *inputFile1;
     char *inputFile2;
     int MatrixSize;
+    JobOptions options;
 
-    if (readCommandLineArguments(argc, argv, &inputFile1, &inputFile2, &MatrixSize) != 0)  // read command line arguments
+    if (readCommandLineArguments(argc, argv, &inputFile1, &inputFile2, &MatrixSize, &options) != 0)  // read command line arguments
     {
         return -1;
     }
@@ -20,37 +31,77 @@ int main(int argc, char **argv)
     // MPI Initialization
     // -----------------------
 
-    int rank = -1, numOfProcesses = -1;
-    MPI_Init(&argc, &argv);
+    int rank = -1, numOfProcesses = -1, threadLevel = MPI_THREAD_SINGLE;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadLevel);   // worker threads compute, only the main thread calls MPI
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &numOfProcesses);
 
+    int threads = configureThreads(options.threads, threadLevel);   // per-rank thread pool
+    setMatrixHugePages(options.hugePages);   // huge-page backing for matrix storage
+    if (rank == 0 && options.threads > 1)
+    {
+        printf("Threads per rank: %d\n", threads);
+    }
+
+    if (rank == 0 && !options.sparse)
+    {
+        options.sparse = isCoordinateMatrixFile(inputFile1) || isCoordinateMatrixFile(inputFile2);   // MatrixMarket input is taken to be sparse
+    }
+    MPI_Bcast(&options.sparse, 1, MPI_INT, 0, MPI_COMM_WORLD);   // only the master may see the input with --input=master
+
+    startPhaseTimer();   // every rank times the phases of the job from here on
+
     // -----------------------
-    // Process Setup
+    // Alternative Engines
     // -----------------------
 
-    int processSize = numOfProcesses;
-    int Mappers = numOfProcesses - 1;
-    int dropout = 100000;
+    if (options.engine == ENGINE_SUMMA)
+    {
+        runSummaEngine(rank, numOfProcesses, inputFile1, inputFile2, MatrixSize, &options);   // 2D block SUMMA on all ranks
+        reportPhaseTimes(rank, MatrixSize, &options);
+        MPI_Finalize();
+        return 0;
+    }
 
-    if (!(MatrixSize % Mappers == 0 && Mappers != 1) || numOfProcesses == 1)
+    if (options.engine == ENGINE_CANNON)
     {
-        if (numOfProcesses > 1)
+        if (runCannonEngine(rank, numOfProcesses, inputFile1, inputFile2, MatrixSize, &options) != 0)   // Cannon's algorithm on a square grid
         {
-            while (MatrixSize % Mappers != 0)
-            {
-                dropout = numOfProcesses - 1;
-                --numOfProcesses;
-                Mappers = numOfProcesses - 1;
-            }
+            MPI_Finalize();
+            return -1;
         }
-        else
+        reportPhaseTimes(rank, MatrixSize, &options);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (options.schedule == SCHEDULE_DYNAMIC)
+    {
+        if (runDynamicSchedule(rank, numOfProcesses, inputFile1, inputFile2, MatrixSize, &options) != 0)   // workers pull map and reduce tasks from the master
         {
-            exit(0);
+            MPI_Finalize();
+            return -1;
         }
+        reportPhaseTimes(rank, MatrixSize, &options);
+        MPI_Finalize();
+        return 0;
     }
 
-    int Splits = MatrixSize / Mappers;
+    // -----------------------
+    // Process Setup
+    // -----------------------
+
+    // Every rank but the master maps. Rows and output cells are split into contiguous blocks
+    // whose lengths differ by at most one, so no rank is left out whatever the matrix size.
+
+    if (numOfProcesses == 1)
+    {
+        printf("Error: The mapreduce engine needs at least one mapper besides the master.\n");
+        MPI_Finalize();
+        return -1;
+    }
+
+    int Mappers = numOfProcesses - 1;
     int Reducers = Mappers / 2;
 
     if (Mappers == 1)
@@ -62,129 +113,272 @@ int main(int argc, char **argv)
     // Reducer Initialization
     // -----------------------
 
-    int reducerSplits = MatrixSize * MatrixSize / Reducers;
-    int *dynamicReducers = initializeReducerRanks(Reducers, numOfProcesses);    // initialize reducer ranks
+    int *dynamicReducers = initializeReducerRanks(Reducers);    // initialize reducer ranks
+    if (rank == 0)
+    {
+        printDistribution(Mappers, Reducers, MatrixSize);   // rows per mapper and cells per reducer
+    }
+
+    MPI_Comm workerComm = MPI_COMM_NULL;
+    if (options.shuffle == SHUFFLE_DIRECT)
+    {
+        workerComm = createWorkerCommunicator(rank, Mappers);   // communicator of all mappers, collective so created before the distribution
+    }
 
     // -----------------------
     // Master Section
     // -----------------------
 
+    MapperInput input = {0, 0, NULL, NULL, NULL};   // rows of A and B this rank maps
+    ReducerOutput reducerOutput = {0, 0, NULL};   // cells this rank reduces
+    NodeInput nodeInput = {MPI_COMM_NULL, MPI_WIN_NULL, 0, 0};   // node-shared copy of the input with --input=shared
+    RmaInput rmaInput = {MPI_WIN_NULL, MPI_WIN_NULL, 0, 0};   // the master's input windows with --input=rma
+    Matrix *matrix1 = NULL;
+    Matrix *matrix2 = NULL;
+
     if (rank == 0)
     {
-        int **matrix1;
-        int **matrix2;
-        populateMatricesFromFile(inputFile1, inputFile2, MatrixSize, &matrix1, &matrix2);   // populate matrices from files
         char *machineName = malloc(sizeof(char) * MPI_MAX_PROCESSOR_NAME);
         int l;
         MPI_Get_processor_name(machineName, &l);
         printMasterDetails(rank, machineName);
-        sendMatrixRowsToMappers(rank, Mappers, Splits, MatrixSize, matrix1, matrix2);  // send matrix rows to mappers
-        freeMasterResources(matrix1, matrix2, machineName, MatrixSize);   // free master resources
+        printBatchSize(resolveBatchSize(&options, MatrixSize));
+
+        if (options.input == INPUT_MASTER || options.input == INPUT_RMA)
+        {
+            enterPhase(PHASE_READ);
+            populateMatricesFromFile(inputFile1, inputFile2, MatrixSize, &matrix1, &matrix2);   // populate matrices from files
+        }
+        if (options.input == INPUT_MASTER)
+        {
+            enterPhase(PHASE_DISPATCH);
+            if (streamsInputRows(&options))
+            {
+                streamRowsToMappers(Mappers, MatrixSize, matrix1, matrix2, rankThreadCount(), options.streamWindow);  // send the rows a group at a time
+            }
+            else
+            {
+                sendMatrixRowsToMappers(Mappers, MatrixSize, matrix1, matrix2, options.mapMode);  // send matrix rows to mappers
+            }
+        }
+
+        if (options.input == INPUT_RMA)
+        {
+            free(machineName);   // the matrices stay exposed until the end of the job
+        }
+        else
+        {
+            freeMasterResources(matrix1, matrix2, machineName);   // free master resources
+            matrix1 = NULL;
+            matrix2 = NULL;
+        }
     }
 
     // -----------------------
-    // Barrier Synchronization
+    // Input Distribution
     // -----------------------
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    // No barrier after the distribution: a mapper's whole block travels in one message, which
+    // only completes once the mapper has posted its receive.
+
+    if (options.input == INPUT_RMA)
+    {
+        enterPhase(PHASE_READ);
+        exposeInputMatrices(rank, matrix1, matrix2, &rmaInput);   // collective, only the master's windows hold data
+        if (rank >= 1 && rank <= Mappers)
+        {
+            fetchRowsRma(&rmaInput, MatrixSize, options.mapMode, blockStart(rank - 1, Mappers, MatrixSize),
+                         blockLength(rank - 1, Mappers, MatrixSize), rankThreadCount(), &input);   // mapping starts with the first group, the rest follows
+        }
+        for (int i = 1; rank == 0 && i < Mappers + 1; i++)
+        {
+            printf("Task Map Assigned to process %d.\n", i);
+        }
+    }
+    else if (options.input != INPUT_MASTER)
+    {
+        enterPhase(PHASE_READ);
+        if (options.input == INPUT_SHARED)
+        {
+            readRowBlocksShared(rank, Mappers, MatrixSize, inputFile1, inputFile2, options.mapMode, &input, &nodeInput);   // one copy per node, mappers get views of it
+        }
+        else
+        {
+            readRowBlocksCollective(rank, Mappers, MatrixSize, inputFile1, inputFile2, options.mapMode, &input);   // every mapper reads its own rows
+        }
+        for (int i = 1; rank == 0 && i < Mappers + 1; i++)
+        {
+            printf("Task Map Assigned to process %d.\n", i);
+        }
+    }
+    else if (rank >= 1 && rank <= Mappers && !streamsInputRows(&options))
+    {
+        enterPhase(PHASE_DISPATCH);
+        receiveRowBlock(MatrixSize, options.mapMode, &input);   // rows sent by the master
+    }
 
     // -----------------------
     // Mapper Tasks
     // -----------------------
 
-    if (rank != 0 && rank < dropout)
+    if (options.shuffle == SHUFFLE_MASTER && rank != 0)
     {
-        processTaskMap(rank, dropout, Splits, MatrixSize);
+        enterPhase(PHASE_MAP);
+        processTaskMap(rank, MatrixSize, &options, &input);
     }
 
     // -----------------------
-    // Barrier Synchronization
+    // Direct Shuffle
     // -----------------------
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    // Mappers exchange their pairs with the reducers themselves, rank 0 only collects results.
+
+    if (options.shuffle == SHUFFLE_DIRECT)
+    {
+        if (workerComm != MPI_COMM_NULL)
+        {
+            enterPhase(PHASE_MAP);
+            processTaskMapDirect(rank, MatrixSize, dynamicReducers, Reducers, workerComm, &options, &input, &reducerOutput);
+            MPI_Comm_free(&workerComm);
+        }
+        if (rank == 0)
+        {
+            for (int t = 0; t < Reducers; t++)
+            {
+                printf("Task Reduce Assigned to process %d.\n", dynamicReducers[t]);
+            }
+        }
+    }
 
     // -----------------------
-    // Master Receives Mapper Data
+    // Streaming Shuffle
     // -----------------------
 
-    if (rank == 0)
+    // Mappers stream their pairs to the reducers while they map, reducers reduce each key as
+    // soon as it is complete. Nothing waits for a whole stage to finish.
+
+    if (options.shuffle == SHUFFLE_STREAM)
     {
-        MatrixKey keys[MatrixSize * MatrixSize * MatrixSize * 2];          // initialize keys and values
-        MatrixValue values[MatrixSize * MatrixSize * MatrixSize * 2];     // initialize keys and values
-        int i = 0;
-        int j = 1, k = 0, n = 0;
-
-        do
-        {
-            MatrixKey key;
-            MatrixValue value;
-            receiveMapperData(j, &key, &value);  // receive mapper data
-            keys[i] = key;
-            values[i] = value;
-            i++;
-            n++;
-            if (n == MatrixSize * MatrixSize * 2)
+        if (rank >= 1 && rank <= Mappers)
+        {
+            enterPhase(PHASE_MAP);
+            processTaskMapStream(rank, MatrixSize, Mappers, dynamicReducers, Reducers, &options, &input, &reducerOutput);
+        }
+        if (rank == 0)
+        {
+            for (int t = 0; t < Reducers; t++)
             {
-                n = 0;
-                k++;
-
-                if (k == Splits)
-                {
-                    k = 0;
-                    j++;
-                }
+                printf("Task Reduce Assigned to process %d.\n", dynamicReducers[t]);
             }
-        } while (j < Mappers + 1 && k < Splits && n < MatrixSize * MatrixSize * 2);  // loop through all mappers
-
-        assignReduceTask(rank, dynamicReducers, reducerSplits, MatrixSize, keys, values);   // assign reduce task
+        }
     }
 
     // -----------------------
-    // Barrier Synchronization
+    // Master Receives Mapper Data
     // -----------------------
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    // No barrier here: batches are large enough to need a matching receive,
+    // so the master drains them while the mappers are still producing.
+
+    if (options.shuffle == SHUFFLE_MASTER && rank == 0)
+    {
+        enterPhase(PHASE_SHUFFLE);
+        IntermediateStore store;
+        initIntermediateStore(&store, MatrixSize, options.memoryBudgetMB, options.scratchDir);   // bounded buffer for mapper output
+        PairBatch incoming;
+        initPairBatch(&incoming, resolveBatchSize(&options, MatrixSize));   // room for one mapper batch
+        for (int j = 1; j < Mappers + 1; j++)  // loop through all mappers
+        {
+            long long expectedPairs = pairsPerMapper(blockLength(j - 1, Mappers, MatrixSize), MatrixSize, options.mapMode);
+            long long received = 0;
+            while (options.sparse || received < expectedPairs)
+            {
+                int count = receiveMapperData(j, incoming.keys, incoming.values);  // receive one batch of mapper data
+                if (count == 0)
+                {
+                    break;   // sparse mappers end their output with an empty batch
+                }
+                storeAppend(&store, incoming.keys, incoming.values, count);
+                received += count;
+            }
+        }
+        freePairBatch(&incoming);
+
+        assignReduceTask(dynamicReducers, Reducers, MatrixSize, &store);   // assign reduce task
+        freeIntermediateStore(&store);
+    }
 
     // -----------------------
     // Perform Reduce Tasks
     // -----------------------
 
+    // No barrier before this stage: each key's bucket goes out as one message, so the
+    // reducers have to be receiving while the master streams the buckets.
+
     int indexofred = 0;
-    while (indexofred < Reducers)  // loop through all reducers
+    while (options.shuffle == SHUFFLE_MASTER && indexofred < Reducers)  // loop through all reducers
     { 
         if (rank == dynamicReducers[indexofred])        
         {
-            performReduceMap(rank, MatrixSize, reducerSplits);   // perform reduce task
-            free(dynamicReducers);
+            enterPhase(PHASE_REDUCE);
+            initReducerOutput(&reducerOutput, indexofred, Reducers, MatrixSize);   // this reducer's run of keys
+            performReduceMap(rank, MatrixSize, options.sparse, &reducerOutput);   // perform reduce task
         }
         indexofred++;  // increment index
     }
 
     // -----------------------
-    // Barrier Synchronization
+    // Write Output to File
     // -----------------------
 
+    enterPhase(PHASE_NONE);
     MPI_Barrier(MPI_COMM_WORLD);
+    // The output needs every reducer's cells anyway, waiting for them here keeps the wait out of the output phases
+
+    if (options.output == OUTPUT_COLLECTIVE)
+    {
+        enterPhase(PHASE_WRITE);
+        writeResultsCollective(rank, MatrixSize, &reducerOutput, &options);   // reducers write their cells in place
+    }
+    else
+    {
+        enterPhase(PHASE_GATHER);
+        Matrix *outputarr = rank == 0 ? allocateMatrix(MatrixSize, MatrixSize) : NULL;    // allocate memory for output matrix
+
+        writeResultToFile(rank, MatrixSize, outputarr, &options, &reducerOutput);  // reducers return their blocks, the master writes the file
+
+        freeMatrix(outputarr);
+    }
 
     // -----------------------
-    // Write Output to File
+    // Verify the Result
     // -----------------------
 
-    if (rank == 0)
-    {
-
-        int **outputarr = allocateMatrix(MatrixSize);    // allocate memory for output matrix
+    // Mappers still hold their rows of A and B and reducers their cells of C, so the check
+    // needs no file and no process holds more than it did during the job.
 
-        writeResultToFile(rank, MatrixSize, outputarr, inputFile1, inputFile2);  // write output to file
+    MatrixPiece pieceA, pieceB, piecesC[MAX_RESULT_PIECES];
+    int inputPieces = mapperInputPieces(&input, MatrixSize, options.mapMode, &pieceA, &pieceB);
+    int resultPieces = cellRangePieces(reducerOutput.firstKey, reducerOutput.numKeys, reducerOutput.values, MatrixSize, piecesC);
+    verifyJobResult(rank, inputFile1, inputFile2, MatrixSize, &options, &pieceA, inputPieces, &pieceB, inputPieces, piecesC, resultPieces);
 
+    // -----------------------
+    // Phase Timings
+    // -----------------------
 
-        free(outputarr);
-    }
+    reportPhaseTimes(rank, MatrixSize, &options);   // slowest rank of every phase, and a timings record if asked for
 
     // -----------------------
     // Barrier Synchronization
     // -----------------------
 
+    freeMapperInput(&input);   // ranks that did not map still hold empty blocks
+    freeReducerOutput(&reducerOutput);
+    freeNodeInput(&nodeInput);   // collective over the node, after every mapper is done with its views
+    freeRmaInput(&rmaInput);   // collective, every mapper has its rows by now
+    freeMatrix(matrix1);
+    freeMatrix(matrix2);
+    free(dynamicReducers);
     MPI_Barrier(MPI_COMM_WORLD);
     MPI_Finalize();
 
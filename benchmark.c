@@ -0,0 +1,412 @@
+#include "matrix_file.h"
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+
+// Runs the job over a range of matrix sizes and process counts and reports where the time goes.
+// Every run appends its phase times (see phase_timer.c) to a scratch timings file; the fastest
+// of the repeated runs of a configuration is kept. Strong scaling runs every size on every
+// process count, weak scaling grows the size with the process count so the work per process
+// (size^3 / processes) stays the same. The results go out as CSV and, if asked for, JSON.
+//
+// Usage: benchmark --sizes=<n,n,..> --procs=<p,p,..> [--weak-size=<n>] [--repeat=<runs>]
+//                  [--mpirun=<command>] [--program=<path>] [--csv=<file>] [--json=<file>]
+//                  [--work-dir=<path>] [-- <job options>]
+
+#define MAX_POINTS 32
+#define MAX_COLUMNS 16
+
+typedef struct {
+    const char *scaling;        // "strong" or "weak"
+    int size;
+    int processes;
+    int threads;
+    int verified;               // the job's comparison with the serial product returned True
+    int columns;                // timing columns, total first and then one per phase
+    double seconds[MAX_COLUMNS];
+    double speedup;             // against the smallest process count of the same series
+    double efficiency;
+} BenchmarkPoint;
+
+static int parseList(const char *text, int *values, int capacity)
+{
+    // Function to read a comma separated list of positive integers
+    // Returns the number of values, or -1 if the list is empty, too long or not made of positive integers
+
+    int count = 0;
+    while (*text != '\0')
+    {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value <= 0 || count == capacity || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+        values[count++] = (int)value;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return count > 0 ? count : -1;
+}
+
+static int writeInputs(const char *workDir, int size, char *fileA, char *fileB)
+{
+    // Function to write a pair of random size x size binary input files, unless they already exist
+    // Inputs:
+    // - workDir: directory the inputs go to
+    // - fileA, fileB: receive the file names, PATH_MAX long
+
+    snprintf(fileA, PATH_MAX, "%s/bench_A_%d.bin", workDir, size);
+    snprintf(fileB, PATH_MAX, "%s/bench_B_%d.bin", workDir, size);
+    if (access(fileA, R_OK) == 0 && access(fileB, R_OK) == 0)
+    {
+        return 0;
+    }
+
+    srand(size);
+    // The same size always gets the same matrices, so reruns compare like with like
+
+    int status = 0;
+    for (int m = 0; m < 2 && status == 0; m++)
+    {
+        Matrix *matrix = allocateMatrix(size, size);
+        for (int i = 0; i < size; i++)
+        {
+            for (int j = 0; j < size; j++)
+            {
+                MATRIX_AT(matrix, i, j) = rand() % 10;
+            }
+        }
+        status = writeBinaryMatrix(m == 0 ? fileA : fileB, matrix);
+        freeMatrix(matrix);
+    }
+    return status;
+}
+
+static int runJob(const char *mpirun, const char *program, const char *jobOptions, const char *workDir, int size, int processes, char names[][32], BenchmarkPoint *point)
+{
+    // Function to run the job once and read back its timings record
+    // Inputs:
+    // - mpirun, program, jobOptions: how to start the job and what to pass it besides the inputs
+    // - workDir: directory of the inputs, the timings file and the job's log
+    // - size, processes: the configuration to run
+    // - names: receive the names of the timing columns
+    // - point: receives the threads, timings and verification result of the run
+    // Returns 0 on success, -1 if the job failed or left no record
+
+    char fileA[PATH_MAX], fileB[PATH_MAX], timings[PATH_MAX], log[PATH_MAX];
+    if (writeInputs(workDir, size, fileA, fileB) != 0)
+    {
+        return -1;
+    }
+    snprintf(timings, sizeof(timings), "%s/bench_timings.csv", workDir);
+    snprintf(log, sizeof(log), "%s/bench_%d_%d.log", workDir, size, processes);
+    remove(timings);
+
+    size_t length = strlen(mpirun) + strlen(program) + strlen(jobOptions) + 4 * PATH_MAX + 64;
+    char *command = (char *)malloc(length);
+    snprintf(command, length, "%s -np %d %s %s %s %d --timings=%s %s > %s 2>&1", mpirun, processes, program, fileA, fileB,
+             size, timings, jobOptions, log);
+    int status = system(command);
+    free(command);
+    if (status != 0)
+    {
+        printf("Error: Run with size %d on %d processes failed, see %s\n", size, processes, log);
+        return -1;
+    }
+
+    FILE *file = fopen(timings, "r");
+    if (file == NULL)
+    {
+        printf("Error: Run with size %d on %d processes left no timings, see %s\n", size, processes, log);
+        return -1;
+    }
+
+    char header[1024], record[1024];
+    if (fgets(header, sizeof(header), file) == NULL || fgets(record, sizeof(record), file) == NULL)
+    {
+        fclose(file);
+        printf("Error: Unreadable timings file %s\n", timings);
+        return -1;
+    }
+    fclose(file);
+
+    // The record holds the job's configuration, then "total" and one column per phase
+
+    int field = 0, column = -1;
+    point->columns = 0;
+    char *savedHeader, *savedRecord;
+    char *name = strtok_r(header, ",\n", &savedHeader);
+    char *value = strtok_r(record, ",\n", &savedRecord);
+    while (name != NULL && value != NULL && point->columns < MAX_COLUMNS)
+    {
+        if (strcmp(name, "threads") == 0)
+        {
+            point->threads = atoi(value);
+        }
+        if (strcmp(name, "total") == 0)
+        {
+            column = field;
+        }
+        if (column >= 0)
+        {
+            snprintf(names[point->columns], 32, "%s", name);
+            point->seconds[point->columns++] = atof(value);
+        }
+        field++;
+        name = strtok_r(NULL, ",\n", &savedHeader);
+        value = strtok_r(NULL, ",\n", &savedRecord);
+    }
+
+    // The job prints the outcome of its comparison, a wrong product still has valid timings
+
+    point->verified = 0;
+    file = fopen(log, "r");
+    char line[1024];
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strstr(line, "Returned: True") != NULL)
+        {
+            point->verified = 1;
+        }
+    }
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    return column >= 0 ? 0 : -1;
+}
+
+static int measure(const char *scaling, int size, int processes, int repeat, const char *mpirun, const char *program,
+                   const char *jobOptions, const char *workDir, char names[][32], BenchmarkPoint *point)
+{
+    // Function to run one configuration 'repeat' times and keep the fastest run
+
+    point->scaling = scaling;
+    point->size = size;
+    point->processes = processes;
+    point->seconds[0] = -1.0;
+
+    for (int run = 0; run < repeat; run++)
+    {
+        BenchmarkPoint attempt = *point;
+        if (runJob(mpirun, program, jobOptions, workDir, size, processes, names, &attempt) != 0)
+        {
+            return -1;
+        }
+        if (point->seconds[0] < 0 || attempt.seconds[0] < point->seconds[0])
+        {
+            *point = attempt;
+        }
+    }
+
+    printf("%-6s size %6d  processes %4d  total %10.4f s  %s\n", scaling, size, processes, point->seconds[0],
+           point->verified ? "verified" : "NOT VERIFIED");
+    return 0;
+}
+
+//--------------------------------------------------------------------//
+
+static void writeCsv(const char *filename, const BenchmarkPoint *points, int count, char names[][32])
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error: Unable to open %s\n", filename);
+        return;
+    }
+
+    fprintf(file, "scaling,size,processes,threads,verified");
+    for (int c = 0; count > 0 && c < points[0].columns; c++)
+    {
+        fprintf(file, ",%s", names[c]);
+    }
+    fprintf(file, ",speedup,efficiency\n");
+
+    for (int p = 0; p < count; p++)
+    {
+        fprintf(file, "%s,%d,%d,%d,%d", points[p].scaling, points[p].size, points[p].processes, points[p].threads, points[p].verified);
+        for (int c = 0; c < points[p].columns; c++)
+        {
+            fprintf(file, ",%.6f", points[p].seconds[c]);
+        }
+        fprintf(file, ",%.4f,%.4f\n", points[p].speedup, points[p].efficiency);
+    }
+    fclose(file);
+}
+
+static void writeJson(const char *filename, const BenchmarkPoint *points, int count, char names[][32], const char *jobOptions)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error: Unable to open %s\n", filename);
+        return;
+    }
+
+    fprintf(file, "{\n  \"options\": \"");
+    for (const char *c = jobOptions; *c != '\0'; c++)
+    {
+        fprintf(file, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+    }
+    fprintf(file, "\",\n  \"runs\": [\n");
+
+    for (int p = 0; p < count; p++)
+    {
+        fprintf(file, "    {\"scaling\": \"%s\", \"size\": %d, \"processes\": %d, \"threads\": %d, \"verified\": %s, \"seconds\": {",
+                points[p].scaling, points[p].size, points[p].processes, points[p].threads, points[p].verified ? "true" : "false");
+        for (int c = 0; c < points[p].columns; c++)
+        {
+            fprintf(file, "%s\"%s\": %.6f", c > 0 ? ", " : "", names[c], points[p].seconds[c]);
+        }
+        fprintf(file, "}, \"speedup\": %.4f, \"efficiency\": %.4f}%s\n", points[p].speedup, points[p].efficiency, p + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+//--------------------------------------------------------------------//
+
+int main(int argc, char **argv)
+{
+    int sizes[MAX_POINTS], procs[MAX_POINTS];
+    int numSizes = 0, numProcs = 0;
+    int weakSize = 0;
+    int repeat = 3;
+    const char *mpirun = "mpirun";
+    const char *program = "./mpiproject";
+    const char *csvFile = "benchmark.csv";
+    const char *jsonFile = NULL;
+    const char *workDir = ".";
+
+    size_t optionsLength = 1;
+    for (int arg = 1; arg < argc; arg++)
+    {
+        optionsLength += strlen(argv[arg]) + 1;
+    }
+    char *jobOptions = (char *)calloc(optionsLength, 1);
+
+    // -----------------------
+    // Command-line Arguments
+    // -----------------------
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--") == 0)
+        {
+            for (arg++; arg < argc; arg++)
+            {
+                strcat(jobOptions, argv[arg]);
+                strcat(jobOptions, arg + 1 < argc ? " " : "");
+            }
+            // Everything after -- goes to the job unchanged
+        }
+        else if (strncmp(argv[arg], "--sizes=", 8) == 0)
+        {
+            numSizes = parseList(argv[arg] + 8, sizes, MAX_POINTS);
+        }
+        else if (strncmp(argv[arg], "--procs=", 8) == 0)
+        {
+            numProcs = parseList(argv[arg] + 8, procs, MAX_POINTS);
+        }
+        else if (strncmp(argv[arg], "--weak-size=", 12) == 0)
+        {
+            weakSize = atoi(argv[arg] + 12);
+        }
+        else if (strncmp(argv[arg], "--repeat=", 9) == 0)
+        {
+            repeat = atoi(argv[arg] + 9);
+        }
+        else if (strncmp(argv[arg], "--mpirun=", 9) == 0)
+        {
+            mpirun = argv[arg] + 9;
+        }
+        else if (strncmp(argv[arg], "--program=", 10) == 0)
+        {
+            program = argv[arg] + 10;
+        }
+        else if (strncmp(argv[arg], "--csv=", 6) == 0)
+        {
+            csvFile = argv[arg] + 6;
+        }
+        else if (strncmp(argv[arg], "--json=", 7) == 0)
+        {
+            jsonFile = argv[arg] + 7;
+        }
+        else if (strncmp(argv[arg], "--work-dir=", 11) == 0)
+        {
+            workDir = argv[arg] + 11;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[arg]);
+            return -1;
+        }
+    }
+
+    if (numSizes <= 0 || numProcs <= 0 || repeat <= 0 || weakSize < 0)
+    {
+        printf("Usage: %s --sizes=<n,n,..> --procs=<p,p,..> [--weak-size=<n>] [--repeat=<runs>] [--mpirun=<command>] [--program=<path>] [--csv=<file>] [--json=<file>] [--work-dir=<path>] [-- <job options>]\n", argv[0]);
+        return -1;
+    }
+
+    BenchmarkPoint points[2 * MAX_POINTS * MAX_POINTS];
+    char names[MAX_COLUMNS][32];
+    int count = 0;
+
+    // -----------------------
+    // Strong Scaling
+    // -----------------------
+
+    // The same problem on more processes: speedup T(p0) / T(p), efficiency speedup * p0 / p
+
+    for (int s = 0; s < numSizes; s++)
+    {
+        int base = count;
+        for (int p = 0; p < numProcs; p++)
+        {
+            if (measure("strong", sizes[s], procs[p], repeat, mpirun, program, jobOptions, workDir, names, &points[count]) != 0)
+            {
+                return -1;
+            }
+            points[count].speedup = points[base].seconds[0] / points[count].seconds[0];
+            points[count].efficiency = points[count].speedup * procs[0] / procs[p];
+            count++;
+        }
+    }
+
+    // -----------------------
+    // Weak Scaling
+    // -----------------------
+
+    // The work grows with the cube of the size, so size * cbrt(p / p0) keeps it the same per process.
+    // Ideal weak scaling keeps the time constant: efficiency T(p0) / T(p)
+
+    for (int p = 0; weakSize > 0 && p < numProcs; p++)
+    {
+        int base = count - p;
+        int size = (int)lround(weakSize * cbrt((double)procs[p] / procs[0]));
+        if (measure("weak", size, procs[p], repeat, mpirun, program, jobOptions, workDir, names, &points[count]) != 0)
+        {
+            return -1;
+        }
+        points[count].speedup = points[base].seconds[0] * procs[p] / (points[count].seconds[0] * procs[0]);
+        points[count].efficiency = points[base].seconds[0] / points[count].seconds[0];
+        count++;
+    }
+
+    // -----------------------
+    // Results
+    // -----------------------
+
+    writeCsv(csvFile, points, count, names);
+    printf("Wrote %d results to %s\n", count, csvFile);
+    if (jsonFile != NULL)
+    {
+        writeJson(jsonFile, points, count, names, jobOptions);
+        printf("Wrote %d results to %s\n", count, jsonFile);
+    }
+
+    free(jobOptions);
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include "cannon_engine.h"
+#include "gemm_kernel.h"
+#include "matrix_mpiio.h"
+#include "phase_timer.h"
+#include "result_verify.h"
+
+//----------------------------------------------------------    Cannon Engine    ----------------------------------------------------------//
+
+// Cannon's algorithm on a q x q periodic process grid (P = q * q).
+// The matrices are cut into q x q equal tiles, zero-padded when q does not divide the size.
+// After the initial skew (row i of A shifted left by i, column j of B shifted up by j) every
+// rank multiplies its current tiles q times, passing A one step left and B one step up in
+// between. The next tiles are received while the current ones are multiplied.
+// Each rank holds five tiles of (size / q)^2 ints: A, B and C, and a receive tile for each of
+// A and B that makes the overlap possible. Shifting in place would save those two at the cost of
+// waiting on every shift.
+
+static int integerSquareRoot(int value)
+{
+    int root = 0;
+    while ((root + 1) * (root + 1) <= value)
+    {
+        root++;
+    }
+    return root;
+}
+
+// Part of the tile at grid position 'coords' that lies inside the matrix, empty for tiles of padding only
+
+static void tileExtent(const int *coords, int tile, int size, int *rowStart, int *rows, int *colStart, int *cols)
+{
+    *rowStart = coords[0] * tile;
+    *colStart = coords[1] * tile;
+    *rows = *rowStart < size ? (size - *rowStart < tile ? size - *rowStart : tile) : 0;
+    *cols = *colStart < size ? (size - *colStart < tile ? size - *colStart : tile) : 0;
+    if (*rows == 0 || *cols == 0)
+    {
+        *rows = 0;
+        *cols = 0;
+    }
+}
+
+//--------------------------------------------------------------------//
+
+static void distributeTiles(int rank, int numOfProcesses, MPI_Comm grid, int tile, char *inputFile1, char *inputFile2, int size, InputMode input, int *tileA, int *tileB)
+{
+    // Function to hand every rank its unskewed tile of A and B, read by every rank itself
+    // (INPUT_COLLECTIVE, and INPUT_SHARED or INPUT_RMA as no tile is needed twice) or by the master with INPUT_MASTER
+
+    int coords[2];
+
+    if (input != INPUT_MASTER)
+    {
+        enterPhase(PHASE_READ);
+        int rowStart, rows, colStart, cols;
+        MPI_Cart_coords(grid, rank, 2, coords);
+        tileExtent(coords, tile, size, &rowStart, &rows, &colStart, &cols);
+        // Only the part of the tile inside the matrix is read, the padding stays zero
+
+        Matrix *blockA = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile1, size, rowStart, rows, colStart, cols);
+        Matrix *blockB = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile2, size, rowStart, rows, colStart, cols);
+        packMatrixBlock(blockA, 0, tile, 0, tile, tileA);
+        packMatrixBlock(blockB, 0, tile, 0, tile, tileB);
+        freeMatrix(blockA);
+        freeMatrix(blockB);
+
+        for (int dest = 1; rank == 0 && dest < numOfProcesses; dest++)
+        {
+            printf("Task Cannon Assigned to process %d.\n", dest);
+        }
+    }
+    else if (rank == 0)
+    {
+        Matrix *matrix1;
+        Matrix *matrix2;
+        enterPhase(PHASE_READ);
+        populateMatricesFromFile(inputFile1, inputFile2, size, &matrix1, &matrix2);
+
+        enterPhase(PHASE_DISPATCH);
+        int *buffer = (int *)malloc(((size_t)tile * tile + 1) * sizeof(int));
+        for (int dest = 1; dest < numOfProcesses; dest++)
+        {
+            MPI_Cart_coords(grid, dest, 2, coords);
+            packMatrixBlock(matrix1, coords[0] * tile, tile, coords[1] * tile, tile, buffer);
+            MPI_Send(buffer, tile * tile, MPI_INT, dest, 40, MPI_COMM_WORLD);
+            packMatrixBlock(matrix2, coords[0] * tile, tile, coords[1] * tile, tile, buffer);
+            MPI_Send(buffer, tile * tile, MPI_INT, dest, 41, MPI_COMM_WORLD);
+            printf("Task Cannon Assigned to process %d.\n", dest);
+        }
+        packMatrixBlock(matrix1, 0, tile, 0, tile, tileA);
+        packMatrixBlock(matrix2, 0, tile, 0, tile, tileB);
+
+        free(buffer);
+        freeMatrix(matrix1);
+        freeMatrix(matrix2);
+    }
+    else
+    {
+        enterPhase(PHASE_DISPATCH);
+        MPI_Recv(tileA, tile * tile, MPI_INT, 0, 40, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(tileB, tile * tile, MPI_INT, 0, 41, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+}
+
+//--------------------------------------------------------------------//
+
+int runCannonEngine(int rank, int numOfProcesses, char *inputFile1, char *inputFile2, int size, const JobOptions *options)
+{
+    // Function to multiply the input matrices with Cannon's algorithm and write the result on the master
+    // Inputs:
+    // - rank: rank of the current process
+    // - numOfProcesses: number of processes, must be a perfect square
+    // - inputFile1, inputFile2: input matrix files, read by the master
+    // - size: size of the matrices
+    // - options: job options, the output format decides how the result is written
+    // Returns 0, or -1 on every rank when the processes do not form a square grid
+
+    int q = integerSquareRoot(numOfProcesses);
+    if (q * q != numOfProcesses)
+    {
+        if (rank == 0)
+        {
+            printf("Error: Cannon's algorithm needs a square number of processes, got %d.\n", numOfProcesses);
+        }
+        return -1;
+    }
+
+    int tile = (size + q - 1) / q;
+    // Tile edge, the last grid row and column are padded with zeros
+
+    int dims[2] = {q, q};
+    int periods[2] = {1, 1};
+    MPI_Comm grid;
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+    // Periodic in both directions so the shifts wrap around, no reordering
+
+    int coords[2];
+    MPI_Cart_coords(grid, rank, 2, coords);
+
+    char machineName[MPI_MAX_PROCESSOR_NAME];
+    int nameLength;
+    MPI_Get_processor_name(machineName, &nameLength);
+    if (rank == 0)
+    {
+        printMasterDetails(rank, machineName);
+        printf("Cannon process grid: %d x %d, tile %d x %d, local kernel %s\n", q, q, tile, tile, gemmKernelName());
+    }
+
+    size_t tileCells = (size_t)tile * tile;
+    int *tileA = (int *)malloc((tileCells + 1) * sizeof(int));
+    int *tileB = (int *)malloc((tileCells + 1) * sizeof(int));
+    int *tileC = (int *)calloc(tileCells + 1, sizeof(int));
+    int *nextA = (int *)malloc((tileCells + 1) * sizeof(int));
+    int *nextB = (int *)malloc((tileCells + 1) * sizeof(int));
+    // Five tiles in all: the three working tiles, plus one receive buffer per operand so shifts overlap the multiply
+
+    distributeTiles(rank, numOfProcesses, grid, tile, inputFile1, inputFile2, size, options->input, tileA, tileB);
+
+    double multiplyStart = MPI_Wtime();
+
+    enterPhase(PHASE_SHUFFLE);
+    int source, dest;
+    MPI_Cart_shift(grid, 1, -coords[0], &source, &dest);
+    MPI_Sendrecv_replace(tileA, tile * tile, MPI_INT, dest, 50, source, 50, grid, MPI_STATUS_IGNORE);
+    MPI_Cart_shift(grid, 0, -coords[1], &source, &dest);
+    MPI_Sendrecv_replace(tileB, tile * tile, MPI_INT, dest, 51, source, 51, grid, MPI_STATUS_IGNORE);
+    // Initial skew: A(i, j) moves i steps left, B(i, j) moves j steps up
+
+    int leftSource, leftDest, upSource, upDest;
+    MPI_Cart_shift(grid, 1, -1, &leftSource, &leftDest);
+    MPI_Cart_shift(grid, 0, -1, &upSource, &upDest);
+
+    for (int step = 0; step < q; step++)
+    {
+        MPI_Request requests[4];
+        int pending = 0;
+
+        if (step < q - 1)
+        {
+            MPI_Irecv(nextA, tile * tile, MPI_INT, leftSource, 52, grid, &requests[0]);
+            MPI_Irecv(nextB, tile * tile, MPI_INT, upSource, 53, grid, &requests[1]);
+            MPI_Isend(tileA, tile * tile, MPI_INT, leftDest, 52, grid, &requests[2]);
+            MPI_Isend(tileB, tile * tile, MPI_INT, upDest, 53, grid, &requests[3]);
+            pending = 4;
+            // Start passing the current tiles on before using them, they are only read meanwhile
+        }
+
+        enterPhase(PHASE_MAP);
+        gemmAccumulate(tile, tile, tile, tileA, tile, tileB, tile, tileC, tile);
+        enterPhase(PHASE_SHUFFLE);
+
+        if (pending > 0)
+        {
+            MPI_Waitall(pending, requests, MPI_STATUSES_IGNORE);
+            int *swap = tileA;
+            tileA = nextA;
+            nextA = swap;
+            swap = tileB;
+            tileB = nextB;
+            nextB = swap;
+        }
+    }
+
+    enterPhase(PHASE_NONE);
+    double multiplyTime = MPI_Wtime() - multiplyStart;
+    double slowest = 0.0;
+    MPI_Reduce(&multiplyTime, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    printf("Process %d has completed task Cannon on %s.\n", rank, machineName);
+
+    if (options->output == OUTPUT_COLLECTIVE)
+    {
+        enterPhase(PHASE_WRITE);
+        int rowStart, rows, colStart, cols;
+        tileExtent(coords, tile, size, &rowStart, &rows, &colStart, &cols);
+        writeMatrixBlockCollective(MPI_COMM_WORLD, outputFileName(options), size, options->outputFormat, rowStart, rows, colStart, cols, tileC, tile);
+        // Every rank writes the part of its C tile inside the matrix, no gather on the master
+
+        if (rank == 0)
+        {
+            printf("Cannon multiply time: %f seconds\n", slowest);
+            printf("\nJob has been Completed");
+        }
+    }
+    else if (rank == 0)
+    {
+        enterPhase(PHASE_GATHER);
+        Matrix *result = allocateMatrix(size, size);
+        unpackMatrixBlock(result, tileC, 0, tile, 0, tile);
+        for (int sourceRank = 1; sourceRank < numOfProcesses; sourceRank++)
+        {
+            MPI_Recv(nextA, tile * tile, MPI_INT, sourceRank, 42, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Cart_coords(grid, sourceRank, 2, coords);
+            unpackMatrixBlock(result, nextA, coords[0] * tile, tile, coords[1] * tile, tile);
+        }
+        // Collect the C tiles, padding cells fall outside the matrix and are dropped
+        enterPhase(PHASE_NONE);
+
+        printf("Cannon multiply time: %f seconds\n", slowest);
+        printf("\nJob has been Completed");
+        writeOutputMatrix(result, options);
+        freeMatrix(result);
+    }
+    else
+    {
+        enterPhase(PHASE_GATHER);
+        MPI_Send(tileC, tile * tile, MPI_INT, 0, 42, MPI_COMM_WORLD);
+    }
+
+    // After q - 1 shifts rank (i, j) holds A(i, (i + j + q - 1) mod q) and B((i + j + q - 1) mod q, j),
+    // so the tiles of A and B are still spread one per rank and the check can use them where they are
+
+    MPI_Cart_coords(grid, rank, 2, coords);
+    int inner = (coords[0] + coords[1] + q - 1) % q;
+    int tileOfA[2] = {coords[0], inner};
+    int tileOfB[2] = {inner, coords[1]};
+    int rowStart, rows, colStart, cols;
+    tileExtent(tileOfA, tile, size, &rowStart, &rows, &colStart, &cols);
+    MatrixPiece pieceA = matrixPiece(rowStart, rows, colStart, cols, tileA, tile);
+    tileExtent(tileOfB, tile, size, &rowStart, &rows, &colStart, &cols);
+    MatrixPiece pieceB = matrixPiece(rowStart, rows, colStart, cols, tileB, tile);
+    tileExtent(coords, tile, size, &rowStart, &rows, &colStart, &cols);
+    MatrixPiece pieceC = matrixPiece(rowStart, rows, colStart, cols, tileC, tile);
+    verifyJobResult(rank, inputFile1, inputFile2, size, options, &pieceA, 1, &pieceB, 1, &pieceC, 1);
+
+    free(tileA);
+    free(tileB);
+    free(tileC);
+    free(nextA);
+    free(nextB);
+    MPI_Comm_free(&grid);
+    return 0;
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
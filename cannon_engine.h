@@ -0,0 +1,19 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef CANNON_ENGINE_H
+#define CANNON_ENGINE_H
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+int runCannonEngine(int rank, int numOfProcesses, char* inputFile1, char* inputFile2, int size, const JobOptions* options);
+
+
+#endif
@@ -0,0 +1,371 @@
+#include "gemm_kernel.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define GEMM_X86_DISPATCH 1
+#endif
+
+//----------------------------------------------------------    Local GEMM Kernel    ----------------------------------------------------------//
+
+// C += A * B on row-major int blocks with leading dimensions.
+// The inner dimension is cut into KC-long slices and the columns into NC-wide slices so the
+// slice of B being reused stays in cache. Inside a slice, a micro-kernel keeps an MR x NR
+// tile of C in registers while it streams the matching rows of A and columns of B.
+// Products wrap modulo 2^32 in every variant, so all paths give bit-identical results.
+
+#define GEMM_KC 256
+#define GEMM_NC 1024
+#define GEMM_MR 4
+
+typedef void (*GemmKernel)(int rows, int cols, int inner, const int *A, int lda, const int *B, int ldb, int *C, int ldc);
+
+//--------------------------------------------------------------------//
+
+// Scalar update for the rows and columns left over around the vector tiles
+
+static void gemmEdge(int rowStart, int rowEnd, int colStart, int colEnd, int kStart, int kEnd,
+                     const int *A, int lda, const int *B, int ldb, int *C, int ldc)
+{
+    for (int row = rowStart; row < rowEnd; row++)
+    {
+        unsigned int *cRow = (unsigned int *)&C[(size_t)row * ldc];
+        for (int k = kStart; k < kEnd; k++)
+        {
+            unsigned int a = (unsigned int)A[(size_t)row * lda + k];
+            const unsigned int *bRow = (const unsigned int *)&B[(size_t)k * ldb];
+            for (int col = colStart; col < colEnd; col++)
+            {
+                cRow[col] += a * bRow[col];
+            }
+        }
+    }
+}
+
+//Portable fallback: the same blocking, with the micro-kernel left to the compiler
+
+static void gemmPortable(int rows, int cols, int inner, const int *A, int lda, const int *B, int ldb, int *C, int ldc)
+{
+    for (int colBlock = 0; colBlock < cols; colBlock += GEMM_NC)
+    {
+        int colEnd = colBlock + GEMM_NC < cols ? colBlock + GEMM_NC : cols;
+        for (int kBlock = 0; kBlock < inner; kBlock += GEMM_KC)
+        {
+            int kEnd = kBlock + GEMM_KC < inner ? kBlock + GEMM_KC : inner;
+            gemmEdge(0, rows, colBlock, colEnd, kBlock, kEnd, A, lda, B, ldb, C, ldc);
+        }
+    }
+}
+
+#ifdef GEMM_X86_DISPATCH
+
+//--------------------------------------------------------------------//
+
+// AVX2: 4 rows x 16 columns of C in eight 256-bit registers
+
+__attribute__((target("avx2")))
+static void gemmAvx2(int rows, int cols, int inner, const int *A, int lda, const int *B, int ldb, int *C, int ldc)
+{
+    const int NR = 16;
+
+    for (int colBlock = 0; colBlock < cols; colBlock += GEMM_NC)
+    {
+        int colEnd = colBlock + GEMM_NC < cols ? colBlock + GEMM_NC : cols;
+        int vectorEnd = colBlock + (colEnd - colBlock) / NR * NR;
+
+        for (int kBlock = 0; kBlock < inner; kBlock += GEMM_KC)
+        {
+            int kEnd = kBlock + GEMM_KC < inner ? kBlock + GEMM_KC : inner;
+            int rowVectorEnd = rows / GEMM_MR * GEMM_MR;
+
+            for (int col = colBlock; col < vectorEnd; col += NR)
+            {
+                for (int row = 0; row < rowVectorEnd; row += GEMM_MR)
+                {
+                    int *c0 = &C[(size_t)row * ldc + col];
+                    int *c1 = c0 + ldc;
+                    int *c2 = c1 + ldc;
+                    int *c3 = c2 + ldc;
+                    __m256i acc00 = _mm256_loadu_si256((const __m256i *)c0);
+                    __m256i acc01 = _mm256_loadu_si256((const __m256i *)(c0 + 8));
+                    __m256i acc10 = _mm256_loadu_si256((const __m256i *)c1);
+                    __m256i acc11 = _mm256_loadu_si256((const __m256i *)(c1 + 8));
+                    __m256i acc20 = _mm256_loadu_si256((const __m256i *)c2);
+                    __m256i acc21 = _mm256_loadu_si256((const __m256i *)(c2 + 8));
+                    __m256i acc30 = _mm256_loadu_si256((const __m256i *)c3);
+                    __m256i acc31 = _mm256_loadu_si256((const __m256i *)(c3 + 8));
+
+                    const int *a0 = &A[(size_t)row * lda];
+                    const int *a1 = a0 + lda;
+                    const int *a2 = a1 + lda;
+                    const int *a3 = a2 + lda;
+
+                    for (int k = kBlock; k < kEnd; k++)
+                    {
+                        const int *bRow = &B[(size_t)k * ldb + col];
+                        __m256i b0 = _mm256_loadu_si256((const __m256i *)bRow);
+                        __m256i b1 = _mm256_loadu_si256((const __m256i *)(bRow + 8));
+                        __m256i a;
+
+                        a = _mm256_set1_epi32(a0[k]);
+                        acc00 = _mm256_add_epi32(acc00, _mm256_mullo_epi32(a, b0));
+                        acc01 = _mm256_add_epi32(acc01, _mm256_mullo_epi32(a, b1));
+                        a = _mm256_set1_epi32(a1[k]);
+                        acc10 = _mm256_add_epi32(acc10, _mm256_mullo_epi32(a, b0));
+                        acc11 = _mm256_add_epi32(acc11, _mm256_mullo_epi32(a, b1));
+                        a = _mm256_set1_epi32(a2[k]);
+                        acc20 = _mm256_add_epi32(acc20, _mm256_mullo_epi32(a, b0));
+                        acc21 = _mm256_add_epi32(acc21, _mm256_mullo_epi32(a, b1));
+                        a = _mm256_set1_epi32(a3[k]);
+                        acc30 = _mm256_add_epi32(acc30, _mm256_mullo_epi32(a, b0));
+                        acc31 = _mm256_add_epi32(acc31, _mm256_mullo_epi32(a, b1));
+                    }
+
+                    _mm256_storeu_si256((__m256i *)c0, acc00);
+                    _mm256_storeu_si256((__m256i *)(c0 + 8), acc01);
+                    _mm256_storeu_si256((__m256i *)c1, acc10);
+                    _mm256_storeu_si256((__m256i *)(c1 + 8), acc11);
+                    _mm256_storeu_si256((__m256i *)c2, acc20);
+                    _mm256_storeu_si256((__m256i *)(c2 + 8), acc21);
+                    _mm256_storeu_si256((__m256i *)c3, acc30);
+                    _mm256_storeu_si256((__m256i *)(c3 + 8), acc31);
+                }
+                gemmEdge(rowVectorEnd, rows, col, col + NR, kBlock, kEnd, A, lda, B, ldb, C, ldc);
+            }
+            gemmEdge(0, rows, vectorEnd, colEnd, kBlock, kEnd, A, lda, B, ldb, C, ldc);
+        }
+    }
+}
+
+//--------------------------------------------------------------------//
+
+// AVX-512: 4 rows x 32 columns of C in eight 512-bit registers
+
+__attribute__((target("avx512f")))
+static void gemmAvx512(int rows, int cols, int inner, const int *A, int lda, const int *B, int ldb, int *C, int ldc)
+{
+    const int NR = 32;
+
+    for (int colBlock = 0; colBlock < cols; colBlock += GEMM_NC)
+    {
+        int colEnd = colBlock + GEMM_NC < cols ? colBlock + GEMM_NC : cols;
+        int vectorEnd = colBlock + (colEnd - colBlock) / NR * NR;
+
+        for (int kBlock = 0; kBlock < inner; kBlock += GEMM_KC)
+        {
+            int kEnd = kBlock + GEMM_KC < inner ? kBlock + GEMM_KC : inner;
+            int rowVectorEnd = rows / GEMM_MR * GEMM_MR;
+
+            for (int col = colBlock; col < vectorEnd; col += NR)
+            {
+                for (int row = 0; row < rowVectorEnd; row += GEMM_MR)
+                {
+                    int *c0 = &C[(size_t)row * ldc + col];
+                    int *c1 = c0 + ldc;
+                    int *c2 = c1 + ldc;
+                    int *c3 = c2 + ldc;
+                    __m512i acc00 = _mm512_loadu_si512(c0);
+                    __m512i acc01 = _mm512_loadu_si512(c0 + 16);
+                    __m512i acc10 = _mm512_loadu_si512(c1);
+                    __m512i acc11 = _mm512_loadu_si512(c1 + 16);
+                    __m512i acc20 = _mm512_loadu_si512(c2);
+                    __m512i acc21 = _mm512_loadu_si512(c2 + 16);
+                    __m512i acc30 = _mm512_loadu_si512(c3);
+                    __m512i acc31 = _mm512_loadu_si512(c3 + 16);
+
+                    const int *a0 = &A[(size_t)row * lda];
+                    const int *a1 = a0 + lda;
+                    const int *a2 = a1 + lda;
+                    const int *a3 = a2 + lda;
+
+                    for (int k = kBlock; k < kEnd; k++)
+                    {
+                        const int *bRow = &B[(size_t)k * ldb + col];
+                        __m512i b0 = _mm512_loadu_si512(bRow);
+                        __m512i b1 = _mm512_loadu_si512(bRow + 16);
+                        __m512i a;
+
+                        a = _mm512_set1_epi32(a0[k]);
+                        acc00 = _mm512_add_epi32(acc00, _mm512_mullo_epi32(a, b0));
+                        acc01 = _mm512_add_epi32(acc01, _mm512_mullo_epi32(a, b1));
+                        a = _mm512_set1_epi32(a1[k]);
+                        acc10 = _mm512_add_epi32(acc10, _mm512_mullo_epi32(a, b0));
+                        acc11 = _mm512_add_epi32(acc11, _mm512_mullo_epi32(a, b1));
+                        a = _mm512_set1_epi32(a2[k]);
+                        acc20 = _mm512_add_epi32(acc20, _mm512_mullo_epi32(a, b0));
+                        acc21 = _mm512_add_epi32(acc21, _mm512_mullo_epi32(a, b1));
+                        a = _mm512_set1_epi32(a3[k]);
+                        acc30 = _mm512_add_epi32(acc30, _mm512_mullo_epi32(a, b0));
+                        acc31 = _mm512_add_epi32(acc31, _mm512_mullo_epi32(a, b1));
+                    }
+
+                    _mm512_storeu_si512(c0, acc00);
+                    _mm512_storeu_si512(c0 + 16, acc01);
+                    _mm512_storeu_si512(c1, acc10);
+                    _mm512_storeu_si512(c1 + 16, acc11);
+                    _mm512_storeu_si512(c2, acc20);
+                    _mm512_storeu_si512(c2 + 16, acc21);
+                    _mm512_storeu_si512(c3, acc30);
+                    _mm512_storeu_si512(c3 + 16, acc31);
+                }
+                gemmEdge(rowVectorEnd, rows, col, col + NR, kBlock, kEnd, A, lda, B, ldb, C, ldc);
+            }
+            gemmEdge(0, rows, vectorEnd, colEnd, kBlock, kEnd, A, lda, B, ldb, C, ldc);
+        }
+    }
+}
+
+#endif
+
+//----------------------------------------------------------    Dot Product    ----------------------------------------------------------//
+
+// x . y of two int vectors, the reducers' join of a row of A with a column of B.
+// Wraps modulo 2^32 like the GEMM kernels, so every variant gives the same result.
+
+typedef int (*DotKernel)(int n, const int *x, const int *y);
+
+static int dotPortable(int n, const int *x, const int *y)
+{
+    unsigned int sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += (unsigned int)x[i] * (unsigned int)y[i];
+    }
+    return (int)sum;
+}
+
+#ifdef GEMM_X86_DISPATCH
+
+// AVX2: two 8-lane accumulators, summed across lanes at the end
+
+__attribute__((target("avx2")))
+static int dotAvx2(int n, const int *x, const int *y)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_add_epi32(acc0, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)&x[i]), _mm256_loadu_si256((const __m256i *)&y[i])));
+        acc1 = _mm256_add_epi32(acc1, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)&x[i + 8]), _mm256_loadu_si256((const __m256i *)&y[i + 8])));
+    }
+    acc0 = _mm256_add_epi32(acc0, acc1);
+
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    unsigned int sum = (unsigned int)_mm_cvtsi128_si32(half);
+
+    for (; i < n; i++)
+    {
+        sum += (unsigned int)x[i] * (unsigned int)y[i];
+    }
+    return (int)sum;
+}
+
+// AVX-512: two 16-lane accumulators
+
+__attribute__((target("avx512f")))
+static int dotAvx512(int n, const int *x, const int *y)
+{
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm512_add_epi32(acc0, _mm512_mullo_epi32(_mm512_loadu_si512(&x[i]), _mm512_loadu_si512(&y[i])));
+        acc1 = _mm512_add_epi32(acc1, _mm512_mullo_epi32(_mm512_loadu_si512(&x[i + 16]), _mm512_loadu_si512(&y[i + 16])));
+    }
+    unsigned int sum = (unsigned int)_mm512_reduce_add_epi32(_mm512_add_epi32(acc0, acc1));
+
+    for (; i < n; i++)
+    {
+        sum += (unsigned int)x[i] * (unsigned int)y[i];
+    }
+    return (int)sum;
+}
+
+#endif
+
+//--------------------------------------------------------------------//
+
+static GemmKernel selectedKernel = gemmPortable;
+static const char *selectedKernelName = "portable";
+static DotKernel selectedDot = dotPortable;
+
+// Picks the widest kernels the CPU supports. Called once at startup, from configureThreads, before
+// any thread runs a kernel; until then, and without it, every call takes the portable kernels.
+
+void selectGemmKernel(void)
+{
+#ifdef GEMM_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        selectedDot = dotAvx512;
+        selectedKernel = gemmAvx512;
+        selectedKernelName = "avx512";
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        selectedDot = dotAvx2;
+        selectedKernel = gemmAvx2;
+        selectedKernelName = "avx2";
+    }
+#endif
+}
+
+void gemmAccumulate(int rows, int cols, int inner, const int *A, int lda, const int *B, int ldb, int *C, int ldc)
+{
+    // Function to add A * B to C
+    // Inputs:
+    // - rows, cols, inner: C is rows x cols, A is rows x inner, B is inner x cols
+    // - A, B, C: row-major blocks
+    // - lda, ldb, ldc: distance in ints between consecutive rows of each block
+
+    if (rows <= 0 || cols <= 0 || inner <= 0)
+    {
+        return;
+    }
+
+#ifdef _OPENMP
+    int threads = omp_in_parallel() ? 1 : omp_get_max_threads();
+    if (threads > 1 && rows >= threads * GEMM_MR)
+    {
+        int band = (rows + threads - 1) / threads;
+        band = (band + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+        // Each thread takes a band of C rows, whole micro-kernel tiles wherever possible
+
+        #pragma omp parallel for schedule(static)
+        for (int t = 0; t < threads; t++)
+        {
+            int rowStart = t * band;
+            int rowCount = rows - rowStart < band ? rows - rowStart : band;
+            if (rowCount > 0)
+            {
+                selectedKernel(rowCount, cols, inner, &A[(size_t)rowStart * lda], lda, B, ldb, &C[(size_t)rowStart * ldc], ldc);
+            }
+        }
+        return;
+    }
+#endif
+
+    selectedKernel(rows, cols, inner, A, lda, B, ldb, C, ldc);
+}
+
+int dotProduct(int n, const int *x, const int *y)
+{
+    // Function to return x[0] * y[0] + ... + x[n - 1] * y[n - 1], wrapping modulo 2^32
+
+    return selectedDot(n, x, y);
+}
+
+const char *gemmKernelName(void)
+{
+    return selectedKernelName;
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
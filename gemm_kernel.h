@@ -0,0 +1,22 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include<stddef.h>
+
+
+#ifndef GEMM_KERNEL_H
+#define GEMM_KERNEL_H
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+void selectGemmKernel(void);
+void gemmAccumulate(int rows, int cols, int inner, const int* A, int lda, const int* B, int ldb, int* C, int ldc);
+int dotProduct(int n, const int* x, const int* y);
+const char* gemmKernelName(void);
+
+
+#endif
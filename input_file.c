@@ -1,64 +1,212 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
+#include "matrix_mpiio.h"
+#include "random_mix.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-#define N 16
+// Generates the two input matrices, A and B, in parallel. Every element comes from a
+// counter-based generator: a key is derived from the seed, the matrix and the row, and the
+// element is a hash of that key and its column. No element depends on another, so rows are
+// generated on all ranks and threads at once, and a seed always gives the same matrices
+// whatever the number of processes or threads. Each rank generates a contiguous block of rows
+// and the ranks write them into place with one collective MPI-IO write per file.
+//
+// Usage: mpirun -np <processes> input_file <size> [--seed=<n>] [--min=<value>] [--max=<value>]
+//        [--density=<fraction>] [--format=text|binary|coordinate] [--threads=<count>]
+//        [--output-a=<file>] [--output-b=<file>]
 
-int main() {
-    // Seed the random number generator
-    srand(time(NULL));
+typedef struct {
+    int size;
+    uint64_t seed;
+    int minValue;
+    int maxValue;
+    double density;         // fraction of the elements drawn from [minValue, maxValue], the rest are zero
+    MatrixFileFormat format;
+    int threads;
+    char* outputA;
+    char* outputB;
+} GeneratorOptions;
 
-    // Initialize the matrices
-    int ** A = (int**)malloc(N * sizeof(int*));
-    int** B = (int**)malloc(N * sizeof(int*));
+//--------------------------------------------------------------------//
 
-    for (int i = 0; i < N; i++) {
-        A[i] = (int*)malloc(N * sizeof(int));
-        B[i] = (int*)malloc(N * sizeof(int));
-    }
+static void generateRows(const GeneratorOptions *options, int matrix, int rowStart, int rows, int *values)
+{
+    // Function to generate rows rowStart .. rowStart + rows of one matrix
+    // Inputs:
+    // - options: size, seed, value range and density
+    // - matrix: 0 for A, 1 for B, each gets its own stream
+    // - values: receives the rows, packed one after another
+
+    int size = options->size;
+    uint64_t span = (uint64_t)((int64_t)options->maxValue - options->minValue) + 1;
+    uint64_t threshold = options->density >= 1.0 ? UINT64_MAX : (uint64_t)(options->density * 4294967296.0);
+
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+        uint64_t rowKey = mix64(options->seed + GOLDEN_GAMMA * (2 * (uint64_t)(rowStart + r) + matrix + 1));
+        // One stream per row and matrix, the column is the counter within it
 
-    // Generate random values for A and B
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) {
-            A[i][j] = rand() % 10;
-            B[i][j] = rand() % 10;
+        int *row = &values[(size_t)r * size];
+        for (int col = 0; col < size; col++)
+        {
+            uint64_t bits = mix64(rowKey + GOLDEN_GAMMA * (uint64_t)(col + 1));
+            int drawn = (int)((int64_t)options->minValue + (int64_t)(((bits >> 32) * span) >> 32));
+            row[col] = threshold == UINT64_MAX || (bits & 0xffffffffULL) < threshold ? drawn : 0;
+            // The high half picks the value without modulo bias, the low half whether the element is kept
         }
     }
+}
 
-    // Save the matrices to files
-    FILE* fileA = fopen("matrixA.txt", "w");
-    FILE* fileB = fopen("matrixB.txt", "w");
-    
-
-    if (fileA != NULL && fileB != NULL) {
-        for (int i = 0; i < N; i++) {
-            for (int j = 0; j < N; j++) {
-                    
-                    fprintf(fileA, "%d ", A[i][j]);
-                    fprintf(fileB, "%d ", B[i][j]);
-                    
-            }
-            fprintf(fileA, "\n");
-            fprintf(fileB, "\n");
+//--------------------------------------------------------------------//
+
+static int readGeneratorOptions(int argc, char **argv, GeneratorOptions *options)
+{
+    // Function to read the command line, identical on every rank
+    // Returns 0, or -1 with a message when an argument is missing or invalid
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <size> [--seed=<n>] [--min=<value>] [--max=<value>] [--density=<fraction>] [--format=text|binary|coordinate] [--threads=<count>] [--output-a=<file>] [--output-b=<file>]\n", argv[0]);
+        return -1;
+    }
+
+    options->size = atoi(argv[1]);
+    options->seed = 1;
+    options->minValue = 0;
+    options->maxValue = 9;
+    options->density = 1.0;
+    options->format = FORMAT_TEXT;
+    options->threads = 1;
+    options->outputA = NULL;
+    options->outputB = NULL;
 
+    if (options->size <= 0)
+    {
+        printf("Invalid matrix size. Please provide a positive integer.\n");
+        return -1;
+    }
+
+    for (int arg = 2; arg < argc; arg++)
+    {
+        if (strncmp(argv[arg], "--seed=", 7) == 0)
+        {
+            options->seed = strtoull(argv[arg] + 7, NULL, 10);
+        }
+        else if (strncmp(argv[arg], "--min=", 6) == 0)
+        {
+            options->minValue = atoi(argv[arg] + 6);
+        }
+        else if (strncmp(argv[arg], "--max=", 6) == 0)
+        {
+            options->maxValue = atoi(argv[arg] + 6);
+        }
+        else if (strncmp(argv[arg], "--density=", 10) == 0)
+        {
+            options->density = atof(argv[arg] + 10);
+            if (options->density <= 0.0 || options->density > 1.0)
+            {
+                printf("Invalid density. Please provide a fraction in (0, 1].\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[arg], "--format=text") == 0)
+        {
+            options->format = FORMAT_TEXT;
+        }
+        else if (strcmp(argv[arg], "--format=binary") == 0)
+        {
+            options->format = FORMAT_BINARY;
+        }
+        else if (strcmp(argv[arg], "--format=coordinate") == 0)
+        {
+            options->format = FORMAT_COORDINATE;
         }
-        fclose(fileA);
-        fclose(fileB);
+        else if (strncmp(argv[arg], "--threads=", 10) == 0)
+        {
+            options->threads = atoi(argv[arg] + 10);
+            if (options->threads <= 0)
+            {
+                printf("Invalid thread count. Please provide a positive integer.\n");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "--output-a=", 11) == 0)
+        {
+            options->outputA = argv[arg] + 11;
+        }
+        else if (strncmp(argv[arg], "--output-b=", 11) == 0)
+        {
+            options->outputB = argv[arg] + 11;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[arg]);
+            return -1;
+        }
+    }
 
-    } else {
-        printf("Error: Unable to open file\n");
+    if (options->minValue > options->maxValue)
+    {
+        printf("Invalid value range. --min must not be larger than --max.\n");
+        return -1;
     }
 
-    // Deallocate memory
-    for (int i = 0; i < N; i++) {
-        free(A[i]);
-        free(B[i]);
-  
+    const char *extension = options->format == FORMAT_BINARY ? "bin" : options->format == FORMAT_COORDINATE ? "mtx" : "txt";
+    static char defaultA[32], defaultB[32];
+    snprintf(defaultA, sizeof(defaultA), "matrixA.%s", extension);
+    snprintf(defaultB, sizeof(defaultB), "matrixB.%s", extension);
+    options->outputA = options->outputA != NULL ? options->outputA : defaultA;
+    options->outputB = options->outputB != NULL ? options->outputB : defaultB;
+    // Named after the files the job reads by default, in the chosen format
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rank, numOfProcesses, threadLevel;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadLevel);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numOfProcesses);
+
+    GeneratorOptions options;
+    if (readGeneratorOptions(argc, argv, &options) != 0)
+    {
+        MPI_Finalize();
+        return -1;
+    }
+    int threads = configureThreads(options.threads, threadLevel);
+
+    // -----------------------
+    // Generate and Write
+    // -----------------------
+
+    // Rank r generates the r-th block of rows of each matrix, the blocks differ by at most one row
+
+    double start = MPI_Wtime();
+    int rowStart = blockStart(rank, numOfProcesses, options.size);
+    int rows = blockLength(rank, numOfProcesses, options.size);
+    int *values = (int *)malloc(((size_t)rows * options.size + 1) * sizeof(int));
+
+    for (int matrix = 0; matrix < 2; matrix++)
+    {
+        char *filename = matrix == 0 ? options.outputA : options.outputB;
+        generateRows(&options, matrix, rowStart, rows, values);
+        writeMatrixBlockCollective(MPI_COMM_WORLD, filename, options.size, options.format, rowStart, rows, 0, options.size, values, options.size);
+        // Text values are padded to the widest value of the whole matrix, binary files get their checksum
     }
 
-    free(A);
-    free(B);
+    free(values);
 
+    double elapsed = MPI_Wtime() - start;
+    if (rank == 0)
+    {
+        printf("Generated %s and %s: %d x %d, seed %llu, values %d to %d, density %g, on %d processes with %d threads each in %f seconds\n",
+               options.outputA, options.outputB, options.size, options.size, (unsigned long long)options.seed, options.minValue,
+               options.maxValue, options.density, numOfProcesses, threads, elapsed);
+    }
 
+    MPI_Finalize();
     return 0;
 }
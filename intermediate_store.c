@@ -0,0 +1,471 @@
+#include "intermediate_store.h"
+#include <limits.h>
+#include <unistd.h>
+
+#define SPILL_BLOCK 1024    // records buffered per run while it is written or merged
+#define MERGE_FAN_IN 16     // runs merged at once, which also bounds the files open at once
+
+//----------------------------------------------------------    Intermediate Store    ----------------------------------------------------------//
+
+// Keeps the mapper output on the master within a fixed memory budget.
+// Pairs are buffered in memory; when the buffer is full it is sorted by key and written
+// to a scratch file as one run. Once all pairs are in, the runs are merged through a heap
+// while the buckets are handed to the reducers, at most MERGE_FAN_IN at a time; with more
+// runs than that, groups of them are first merged into longer runs. If nothing was
+// spilled the buffer is simply grouped in memory.
+
+void initIntermediateStore(IntermediateStore *store, int size, long memoryBudgetMB, const char *scratchDir)
+{
+    // Function to set up an empty store
+    // Inputs:
+    // - store: the store to initialise
+    // - size: size of the matrices, keys run from 0 to size * size - 1
+    // - memoryBudgetMB: memory the whole store may use, in megabytes
+    // - scratchDir: directory for spilled runs
+
+    int numKeys = size * size;
+    long long budgetBytes = (long long)memoryBudgetMB * 1024 * 1024;
+    long long reservedBytes = (long long)(numKeys + 1) * sizeof(int)
+                            + (long long)(MERGE_FAN_IN + 1) * SPILL_BLOCK * sizeof(SpillRecord)
+                            + 2LL * size * sizeof(MatrixValue);
+    // The key offsets, the run buffers and one merged bucket are needed whatever the pair count
+    if (budgetBytes <= reservedBytes)
+    {
+        printf("Error: --memory-budget=%ld leaves no room for pairs, the store needs %lld bytes for its key index and merge buffers\n", memoryBudgetMB, reservedBytes);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    long long budgetPairs = (budgetBytes - reservedBytes) / (sizeof(MatrixKey) + 2 * sizeof(MatrixValue));
+    // Each buffered pair costs its key and value, plus one value slot when it is grouped
+
+    long long expectedPairs = (long long)size * size * size * 2;
+    if (budgetPairs > expectedPairs)
+    {
+        budgetPairs = expectedPairs;
+    }
+    if (budgetPairs > INT_MAX - 1)
+    {
+        budgetPairs = INT_MAX - 1;
+    }
+    if (budgetPairs < 1)
+    {
+        budgetPairs = 1;
+    }
+
+    store->size = size;
+    store->budgetPairs = (size_t)budgetPairs;
+    store->keys = (MatrixKey *)malloc(store->budgetPairs * sizeof(MatrixKey));
+    store->values = (MatrixValue *)malloc(store->budgetPairs * sizeof(MatrixValue));
+    store->count = 0;
+    store->totalPairs = 0;
+
+    store->scratchDir = scratchDir;
+    store->runPaths = NULL;
+    store->numRuns = 0;
+    store->runsWritten = 0;
+
+    store->records = NULL;
+    store->merge = NULL;
+    store->mergeInputs = 0;
+    store->heap = NULL;
+    store->heapSize = 0;
+
+    store->offsets = (int *)malloc((numKeys + 1) * sizeof(int));
+    store->grouped = NULL;
+    store->bucket = NULL;
+    store->bucketCapacity = 0;
+    store->nextKey = 0;
+    store->groupingTime = 0.0;
+}
+
+//--------------------------------------------------------------------//
+
+static void spillFailure(const char *action, const char *path)
+{
+    printf("Error: Failed to %s spill file %s\n", action, path);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+    // Only the master holds the store, exiting alone would leave the workers blocked
+}
+
+static char *newRunPath(IntermediateStore *store)
+{
+    char *path = (char *)malloc(strlen(store->scratchDir) + 64);
+    sprintf(path, "%s/mapreduce_spill_%d_%d.run", store->scratchDir, (int)getpid(), store->runsWritten++);
+    return path;
+}
+
+static SpillRecord *writeBlock(IntermediateStore *store)
+{
+    // Function to return the buffer runs are written through, allocating the run buffers on first use
+
+    if (store->records == NULL)
+    {
+        store->records = (SpillRecord *)malloc((size_t)(MERGE_FAN_IN + 1) * SPILL_BLOCK * sizeof(SpillRecord));
+        store->merge = (SpillRun *)malloc(MERGE_FAN_IN * sizeof(SpillRun));
+        store->heap = (int *)malloc(MERGE_FAN_IN * sizeof(int));
+    }
+    return &store->records[(size_t)MERGE_FAN_IN * SPILL_BLOCK];
+}
+
+static void writeRecords(FILE *file, const SpillRecord *records, size_t count, const char *path)
+{
+    if (count > 0 && fwrite(records, sizeof(SpillRecord), count, file) != count)
+    {
+        spillFailure("write", path);
+    }
+}
+
+static void closeWrittenRun(FILE *file, const char *path)
+{
+    if (fclose(file) != 0)
+    {
+        spillFailure("write", path);
+    }
+    // fclose flushes the last records, so a full disk may only show up here
+}
+
+static void addRun(IntermediateStore *store, char *path)
+{
+    store->runPaths = (char **)realloc(store->runPaths, (store->numRuns + 1) * sizeof(char *));
+    store->runPaths[store->numRuns++] = path;
+}
+
+static void spillRun(IntermediateStore *store)
+{
+    // Function to sort the buffered pairs by key and write them out as one run
+
+    double groupStart = MPI_Wtime();
+    int numKeys = store->size * store->size;
+
+    int *offsets = store->offsets;
+    MatrixValue *grouped = (MatrixValue *)malloc(store->count * sizeof(MatrixValue));
+    groupPairsByKey(store->keys, store->values, (int)store->count, 0, numKeys, store->size, offsets, grouped);
+
+    char *path = newRunPath(store);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        spillFailure("create", path);
+    }
+
+    SpillRecord *records = writeBlock(store);
+    size_t pending = 0;
+    for (int q = 0; q < numKeys; q++)
+    {
+        for (int p = offsets[q]; p < offsets[q + 1]; p++)
+        {
+            records[pending].keyIndex = q;
+            records[pending].value = grouped[p];
+            pending++;
+            if (pending == SPILL_BLOCK)
+            {
+                writeRecords(file, records, pending, path);
+                pending = 0;
+            }
+        }
+    }
+    writeRecords(file, records, pending, path);
+    closeWrittenRun(file, path);
+    // The run is written in key order, so the merge only has to read it front to back.
+    // It stays closed until then, so the number of runs is not limited by open files.
+
+    addRun(store, path);
+    printf("Spilled run %d (%zu pairs) to %s\n", store->numRuns, store->count, path);
+
+    store->count = 0;
+    free(grouped);
+    store->groupingTime += MPI_Wtime() - groupStart;
+}
+
+void storeAppend(IntermediateStore *store, const MatrixKey *keys, const MatrixValue *values, int count)
+{
+    // Function to add received pairs to the store, spilling whenever the memory budget is used up
+    // Inputs:
+    // - store: the store
+    // - keys, values: the pairs to add, 'count' of them
+
+    int copied = 0;
+    while (copied < count)
+    {
+        if (store->count == store->budgetPairs)
+        {
+            spillRun(store);
+        }
+
+        size_t space = store->budgetPairs - store->count;
+        size_t chunk = (size_t)(count - copied) < space ? (size_t)(count - copied) : space;
+
+        memcpy(&store->keys[store->count], &keys[copied], chunk * sizeof(MatrixKey));
+        memcpy(&store->values[store->count], &values[copied], chunk * sizeof(MatrixValue));
+        store->count += chunk;
+        copied += (int)chunk;
+    }
+    store->totalPairs += count;
+}
+
+//--------------------------------------------------------------------//
+
+static int fillRun(SpillRun *run)
+{
+    // Function to make sure the run has a record at its head, returns 0 once it is exhausted
+
+    if (run->position == run->buffered)
+    {
+        run->buffered = fread(run->buffer, sizeof(SpillRecord), SPILL_BLOCK, run->file);
+        run->position = 0;
+        if (run->buffered == 0)
+        {
+            if (ferror(run->file))
+            {
+                spillFailure("read", run->path);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int headKey(IntermediateStore *store, int input)
+{
+    SpillRun *run = &store->merge[input];
+    return run->buffer[run->position].keyIndex;
+}
+
+static void siftDown(IntermediateStore *store, int slot)
+{
+    // Function to restore the heap order below 'slot'
+    // Ties on the key go to the earlier run, so a key's values come out in the order they were received
+
+    while (1)
+    {
+        int smallest = slot;
+        for (int child = 2 * slot + 1; child <= 2 * slot + 2 && child < store->heapSize; child++)
+        {
+            int childKey = headKey(store, store->heap[child]);
+            int smallestKey = headKey(store, store->heap[smallest]);
+            if (childKey < smallestKey || (childKey == smallestKey && store->heap[child] < store->heap[smallest]))
+            {
+                smallest = child;
+            }
+        }
+        if (smallest == slot)
+        {
+            return;
+        }
+        int swap = store->heap[slot];
+        store->heap[slot] = store->heap[smallest];
+        store->heap[smallest] = swap;
+        slot = smallest;
+    }
+}
+
+static void openMerge(IntermediateStore *store, int firstRun, int numInputs)
+{
+    // Function to open 'numInputs' runs starting at 'firstRun' and order them in the heap
+
+    store->mergeInputs = numInputs;
+    store->heapSize = 0;
+    for (int input = 0; input < numInputs; input++)
+    {
+        SpillRun *run = &store->merge[input];
+        run->path = store->runPaths[firstRun + input];
+        run->file = fopen(run->path, "rb");
+        if (run->file == NULL)
+        {
+            spillFailure("open", run->path);
+        }
+        run->buffer = &store->records[(size_t)input * SPILL_BLOCK];
+        run->buffered = 0;
+        run->position = 0;
+        if (fillRun(run))
+        {
+            store->heap[store->heapSize++] = input;
+        }
+    }
+    for (int slot = store->heapSize / 2 - 1; slot >= 0; slot--)
+    {
+        siftDown(store, slot);
+    }
+}
+
+static void advanceMerge(IntermediateStore *store)
+{
+    // Function to consume the record at the top of the heap
+
+    SpillRun *run = &store->merge[store->heap[0]];
+    run->position++;
+    if (!fillRun(run))
+    {
+        store->heap[0] = store->heap[--store->heapSize];
+    }
+    siftDown(store, 0);
+}
+
+static void closeMerge(IntermediateStore *store)
+{
+    for (int input = 0; input < store->mergeInputs; input++)
+    {
+        fclose(store->merge[input].file);
+    }
+    store->mergeInputs = 0;
+    store->heapSize = 0;
+}
+
+static void mergePass(IntermediateStore *store)
+{
+    // Function to merge the runs in groups of MERGE_FAN_IN, leaving one longer run per group
+
+    int numMerged = (store->numRuns + MERGE_FAN_IN - 1) / MERGE_FAN_IN;
+    char **mergedPaths = (char **)malloc(numMerged * sizeof(char *));
+    SpillRecord *records = writeBlock(store);
+
+    for (int group = 0; group < numMerged; group++)
+    {
+        int firstRun = group * MERGE_FAN_IN;
+        int numInputs = store->numRuns - firstRun < MERGE_FAN_IN ? store->numRuns - firstRun : MERGE_FAN_IN;
+        openMerge(store, firstRun, numInputs);
+
+        char *path = newRunPath(store);
+        FILE *file = fopen(path, "wb");
+        if (file == NULL)
+        {
+            spillFailure("create", path);
+        }
+
+        size_t pending = 0;
+        while (store->heapSize > 0)
+        {
+            SpillRun *run = &store->merge[store->heap[0]];
+            records[pending++] = run->buffer[run->position];
+            if (pending == SPILL_BLOCK)
+            {
+                writeRecords(file, records, pending, path);
+                pending = 0;
+            }
+            advanceMerge(store);
+        }
+        writeRecords(file, records, pending, path);
+        closeWrittenRun(file, path);
+
+        closeMerge(store);
+        for (int run = firstRun; run < firstRun + numInputs; run++)
+        {
+            remove(store->runPaths[run]);
+            free(store->runPaths[run]);
+        }
+        mergedPaths[group] = path;
+    }
+    // Groups are consecutive runs, so the merged runs keep the order the pairs were received in
+
+    free(store->runPaths);
+    store->runPaths = mergedPaths;
+    store->numRuns = numMerged;
+}
+
+void storeFinish(IntermediateStore *store)
+{
+    // Function to close the store for writing and prepare reading it back key by key
+
+    int numKeys = store->size * store->size;
+
+    if (store->numRuns == 0)
+    {
+        double groupStart = MPI_Wtime();
+        store->grouped = (MatrixValue *)malloc((store->count + 1) * sizeof(MatrixValue));
+        groupPairsByKey(store->keys, store->values, (int)store->count, 0, numKeys, store->size, store->offsets, store->grouped);
+        store->groupingTime += MPI_Wtime() - groupStart;
+        // Everything fit in memory, bucket it directly
+    }
+    else
+    {
+        if (store->count > 0)
+        {
+            spillRun(store);
+        }
+
+        double mergeStart = MPI_Wtime();
+        while (store->numRuns > MERGE_FAN_IN)
+        {
+            mergePass(store);
+            printf("Merged spilled runs down to %d\n", store->numRuns);
+        }
+        openMerge(store, 0, store->numRuns);
+        store->groupingTime += MPI_Wtime() - mergeStart;
+        // Every run is now sorted on disk and at most MERGE_FAN_IN of them are open for the final merge
+    }
+
+    free(store->keys);
+    free(store->values);
+    store->keys = NULL;
+    store->values = NULL;
+    store->count = 0;
+    store->nextKey = 0;
+}
+
+int storeNextKey(IntermediateStore *store, int *keyIndex, MatrixValue **values, int *count)
+{
+    // Function to fetch the bucket of the next key, keys come out in ascending order
+    // Inputs:
+    // - store: a store that has been through storeFinish
+    // - keyIndex: receives i * size + k of the key
+    // - values, count: receive the bucket, valid until the next call
+    // Returns 0 once every key has been returned
+
+    if (store->nextKey >= store->size * store->size)
+    {
+        return 0;
+    }
+
+    int q = store->nextKey++;
+    *keyIndex = q;
+
+    if (store->numRuns == 0)
+    {
+        *values = &store->grouped[store->offsets[q]];
+        *count = store->offsets[q + 1] - store->offsets[q];
+        return 1;
+    }
+
+    size_t filled = 0;
+    while (store->heapSize > 0 && headKey(store, store->heap[0]) == q)
+    {
+        if (filled == store->bucketCapacity)
+        {
+            store->bucketCapacity = store->bucketCapacity > 0 ? store->bucketCapacity * 2 : 256;
+            store->bucket = (MatrixValue *)realloc(store->bucket, store->bucketCapacity * sizeof(MatrixValue));
+        }
+        SpillRun *run = &store->merge[store->heap[0]];
+        store->bucket[filled++] = run->buffer[run->position].value;
+        advanceMerge(store);
+    }
+    // Only the runs whose head holds the key are touched, through the top of the heap
+
+    *values = store->bucket;
+    *count = (int)filled;
+    return 1;
+}
+
+//--------------------------------------------------------------------//
+
+void freeIntermediateStore(IntermediateStore *store)
+{
+    closeMerge(store);
+    for (int r = 0; r < store->numRuns; r++)
+    {
+        remove(store->runPaths[r]);
+        free(store->runPaths[r]);
+    }
+    free(store->runPaths);
+    free(store->records);
+    free(store->merge);
+    free(store->heap);
+    free(store->keys);
+    free(store->values);
+    free(store->offsets);
+    free(store->grouped);
+    free(store->bucket);
+    store->numRuns = 0;
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
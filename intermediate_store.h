@@ -0,0 +1,68 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef INTERMEDIATE_STORE_H
+#define INTERMEDIATE_STORE_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+typedef struct {
+    int keyIndex;           // i * size + k of the key the value belongs to
+    MatrixValue value;
+} SpillRecord;
+
+typedef struct {
+    FILE* file;
+    const char* path;
+    SpillRecord* buffer;    // records read ahead from the run
+    size_t buffered;
+    size_t position;
+} SpillRun;
+
+struct IntermediateStore {
+    int size;
+    size_t budgetPairs;     // pairs kept in memory before a sorted run is written out
+    MatrixKey* keys;
+    MatrixValue* values;
+    size_t count;
+    long long totalPairs;
+
+    const char* scratchDir;
+    char** runPaths;        // sorted runs on disk, closed until they are merged
+    int numRuns;
+    int runsWritten;        // numbers the next run file
+
+    SpillRecord* records;   // one block per merge input plus one for writing
+    SpillRun* merge;        // open inputs of the current merge
+    int mergeInputs;
+    int* heap;              // inputs that still have records, ordered by the key at their head
+    int heapSize;
+
+    int* offsets;           // in-memory grouping, bucket q is grouped[offsets[q] .. offsets[q + 1])
+    MatrixValue* grouped;
+    MatrixValue* bucket;    // merge output for the current key when runs were spilled
+    size_t bucketCapacity;
+    int nextKey;
+    double groupingTime;
+};
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+void initIntermediateStore(IntermediateStore* store, int size, long memoryBudgetMB, const char* scratchDir);
+void storeAppend(IntermediateStore* store, const MatrixKey* keys, const MatrixValue* values, int count);
+void storeFinish(IntermediateStore* store);
+int storeNextKey(IntermediateStore* store, int* keyIndex, MatrixValue** values, int* count);
+void freeIntermediateStore(IntermediateStore* store);
+
+
+#endif
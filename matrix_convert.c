@@ -0,0 +1,111 @@
+#include "matrix_file.h"
+
+// Converts matrix files between the text format (matrixA.txt, matrixB.txt, Output.txt), the
+// binary format of matrix_file.h and MatrixMarket coordinate files. The input format is
+// detected from the file itself; by default binary input becomes text and anything else binary.
+//
+// Usage: matrix_convert <input> <output> [--to=text|binary|coordinate]
+
+static const char *formatName(MatrixFileFormat format)
+{
+    return format == FORMAT_BINARY ? "binary" : format == FORMAT_COORDINATE ? "coordinate" : "text";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4)
+    {
+        printf("Usage: %s <input> <output> [--to=text|binary|coordinate]\n", argv[0]);
+        return -1;
+    }
+
+    char *inputFile = argv[1];
+    char *outputFile = argv[2];
+    MatrixFileFormat inputFormat = isBinaryMatrixFile(inputFile) ? FORMAT_BINARY
+                                 : isCoordinateMatrixFile(inputFile) ? FORMAT_COORDINATE : FORMAT_TEXT;
+    MatrixFileFormat outputFormat = inputFormat == FORMAT_BINARY ? FORMAT_TEXT : FORMAT_BINARY;
+
+    if (argc == 4)
+    {
+        if (strcmp(argv[3], "--to=text") == 0)
+        {
+            outputFormat = FORMAT_TEXT;
+        }
+        else if (strcmp(argv[3], "--to=binary") == 0)
+        {
+            outputFormat = FORMAT_BINARY;
+        }
+        else if (strcmp(argv[3], "--to=coordinate") == 0)
+        {
+            outputFormat = FORMAT_COORDINATE;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[3]);
+            return -1;
+        }
+    }
+
+    // -----------------------
+    // Read the Input
+    // -----------------------
+
+    int rows, cols;
+    Matrix *matrix;
+    if (inputFormat == FORMAT_BINARY)
+    {
+        matrix = mapBinaryMatrix(inputFile, &rows, &cols);
+    }
+    else if (inputFormat == FORMAT_COORDINATE)
+    {
+        if (coordinateMatrixDimensions(inputFile, &rows, &cols) != 0)
+        {
+            return -1;
+        }
+        matrix = allocateMatrix(rows, cols);
+        if (readCoordinateBlock(inputFile, matrix, 0, 0) != 0)
+        {
+            freeMatrix(matrix);
+            matrix = NULL;
+        }
+    }
+    else
+    {
+        if (textMatrixDimensions(inputFile, &rows, &cols) != 0)
+        {
+            return -1;
+        }
+        matrix = readTextMatrix(inputFile, rows, cols);
+    }
+    if (matrix == NULL)
+    {
+        return -1;
+    }
+
+    // -----------------------
+    // Write the Output
+    // -----------------------
+
+    int status = 0;
+    if (outputFormat == FORMAT_BINARY)
+    {
+        status = writeBinaryMatrix(outputFile, matrix);
+    }
+    else if (outputFormat == FORMAT_COORDINATE)
+    {
+        status = writeCoordinateMatrix(outputFile, matrix);
+    }
+    else
+    {
+        writeMatrixToFile(outputFile, matrix);
+    }
+
+    if (status == 0)
+    {
+        printf("Converted %d x %d matrix %s (%s) to %s (%s)\n", rows, cols, inputFile, formatName(inputFormat),
+               outputFile, formatName(outputFormat));
+    }
+
+    freeMatrix(matrix);
+    return status;
+}
@@ -0,0 +1,433 @@
+#include "matrix_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//----------------------------------------------------------    Matrix Files    ----------------------------------------------------------//
+
+// Matrices are stored either as whitespace separated text, one row per line, or in a binary
+// format: a 64-byte MatrixFileHeader followed by the elements as raw row-major int32.
+// Binary files are mapped into memory and used in place, so loading them costs no parsing.
+// Sparse matrices can also be stored as MatrixMarket coordinate files, which list only the
+// nonzero elements. The format is told apart by the magic or banner at the start of the file.
+
+int isBinaryMatrixFile(const char *filename)
+{
+    // Function to check whether a file starts with the binary matrix header
+    // Returns 1 for a binary matrix file, 0 otherwise (including when it cannot be opened)
+
+    char magic[8];
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    size_t got = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    return got == sizeof(magic) && memcmp(magic, MATRIX_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+// Fletcher-style checksum over the elements in row-major order: a running sum of the
+// elements and a running sum of those sums, so both values and their order are covered.
+
+uint64_t matrixChecksum(const Matrix *matrix)
+{
+    uint64_t sum1 = 0;
+    uint64_t sum2 = 0;
+    for (int row = 0; row < matrix->rows; row++)
+    {
+        const uint32_t *values = (const uint32_t *)MATRIX_ROW(matrix, row);
+        for (int col = 0; col < matrix->cols; col++)
+        {
+            sum1 += values[col];
+            sum2 += sum1;
+        }
+    }
+    return (sum2 << 32) ^ sum1;
+}
+
+//--------------------------------------------------------------------//
+
+Matrix *mapBinaryMatrix(const char *filename, int *rows, int *cols)
+{
+    // Function to map a binary matrix file into memory
+    // Inputs:
+    // - filename: the binary matrix file
+    // - rows, cols: receive the dimensions from the header
+    // Returns the matrix, with its elements left in the private mapping, or NULL on error
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Error: Failed to open file %s\n", filename);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(MatrixFileHeader))
+    {
+        printf("Error: %s is too short to be a binary matrix file\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        printf("Error: Failed to map file %s\n", filename);
+        return NULL;
+    }
+    // Private mapping: the matrix can be modified in memory without touching the file
+
+    const MatrixFileHeader *header = (const MatrixFileHeader *)mapping;
+    size_t elements = (size_t)header->rows * header->cols;
+
+    if (memcmp(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic)) != 0 || header->version != MATRIX_FILE_VERSION ||
+        header->elementType != MATRIX_ELEMENT_INT32 || header->rows > INT32_MAX || header->cols > INT32_MAX ||
+        (size_t)info.st_size < sizeof(MatrixFileHeader) + elements * sizeof(int))
+    {
+        printf("Error: %s has an unsupported or truncated binary matrix header\n", filename);
+        munmap(mapping, info.st_size);
+        return NULL;
+    }
+
+    Matrix *matrix = (Matrix *)malloc(sizeof(Matrix));
+    matrix->rows = (int)header->rows;
+    matrix->cols = (int)header->cols;
+    matrix->stride = matrix->cols > 0 ? matrix->cols : 1;
+    matrix->data = (int *)((char *)mapping + sizeof(MatrixFileHeader));
+    matrix->bytes = info.st_size;
+    matrix->mapping = mapping;
+
+    if (matrixChecksum(matrix) != header->checksum)
+    {
+        printf("Error: Checksum mismatch in %s\n", filename);
+        freeMatrix(matrix);
+        return NULL;
+    }
+
+    *rows = matrix->rows;
+    *cols = matrix->cols;
+    return matrix;
+}
+
+int writeBinaryMatrix(const char *filename, const Matrix *matrix)
+{
+    // Function to write a matrix in the binary format
+    // Returns 0 on success, -1 on error
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        printf("Error: Failed to create file %s\n", filename);
+        return -1;
+    }
+
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = MATRIX_FILE_VERSION;
+    header.elementType = MATRIX_ELEMENT_INT32;
+    header.rows = matrix->rows;
+    header.cols = matrix->cols;
+    header.checksum = matrixChecksum(matrix);
+
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    for (int row = 0; row < matrix->rows && !failed; row++)
+    {
+        failed = fwrite(MATRIX_ROW(matrix, row), sizeof(int), matrix->cols, file) != (size_t)matrix->cols;
+        // Rows are written without their padding
+    }
+
+    if (fclose(file) != 0 || failed)
+    {
+        printf("Error: Failed to write file %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------//
+
+Matrix *readTextMatrix(const char *filename, int rows, int cols)
+{
+    // Function to parse a rows x cols matrix from a whitespace separated text file
+    // Missing elements are left at zero, extra ones are ignored
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        printf("Error: Failed to open file %s\n", filename);
+        return NULL;
+    }
+
+    Matrix *matrix = allocateMatrix(rows, cols);
+
+    int bufferSize = cols * 12 + 2; // Up to 11 characters per int plus a separator, then newline and terminator
+    char *buffer = (char *)malloc(bufferSize);
+
+    int row = 0;
+    while (row < rows && fgets(buffer, bufferSize, file) != NULL)
+    {
+        int col = 0;
+        int length = strlen(buffer);
+        int *values = MATRIX_ROW(matrix, row);
+
+        if (buffer[length - 1] == '\n')
+        {
+            buffer[length - 1] = '\0';
+        }
+
+        char *token = strtok(buffer, " \t");
+
+        while (token != NULL && col < cols)
+        {
+            values[col] = atoi(token);
+            col++;
+            token = strtok(NULL, " \t");
+        }
+
+        row++;
+    }
+    free(buffer);
+    fclose(file);
+    return matrix;
+}
+
+int textMatrixDimensions(const char *filename, int *rows, int *cols)
+{
+    // Function to work out the size of a text matrix: the number of non-empty lines and
+    // the number of values on the first of them
+    // Returns 0 on success, -1 if the file cannot be opened
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        printf("Error: Failed to open file %s\n", filename);
+        return -1;
+    }
+
+    *rows = 0;
+    *cols = 0;
+    int tokens = 0;
+    int inToken = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF)
+    {
+        if (c == '\n')
+        {
+            if (tokens > 0)
+            {
+                if (*rows == 0)
+                {
+                    *cols = tokens;
+                }
+                (*rows)++;
+            }
+            tokens = 0;
+            inToken = 0;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r')
+        {
+            inToken = 0;
+        }
+        else if (!inToken)
+        {
+            inToken = 1;
+            tokens++;
+        }
+    }
+    if (tokens > 0)
+    {
+        if (*rows == 0)
+        {
+            *cols = tokens;
+        }
+        (*rows)++;
+        // Last line without a trailing newline
+    }
+
+    fclose(file);
+    return 0;
+}
+
+
+//----------------------------------------------------------    MatrixMarket Coordinate Files    ----------------------------------------------------------//
+
+// A banner line, comment lines starting with '%', a "rows cols entries" line and then one
+// "row col value" line per nonzero element with 1-based indices, in any order. Only integer
+// general matrices are read; pattern matrices are taken to hold 1 at every listed position.
+
+int isCoordinateMatrixFile(const char *filename)
+{
+    // Function to check whether a file starts with the MatrixMarket banner
+    // Returns 1 for a MatrixMarket file, 0 otherwise (including when it cannot be opened)
+
+    char banner[sizeof(MATRIX_MARKET_BANNER) - 1];
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    size_t got = fread(banner, 1, sizeof(banner), file);
+    fclose(file);
+    return got == sizeof(banner) && memcmp(banner, MATRIX_MARKET_BANNER, sizeof(banner)) == 0;
+}
+
+static FILE *openCoordinateMatrix(const char *filename, int *rows, int *cols, long long *entries, int *pattern)
+{
+    // Function to open a MatrixMarket file and read everything up to the first entry
+    // Returns the file positioned at the first entry, or NULL on error
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        printf("Error: Failed to open file %s\n", filename);
+        return NULL;
+    }
+
+    char line[1024];
+    char object[64], format[64], field[64], symmetry[64];
+    if (fgets(line, sizeof(line), file) == NULL ||
+        sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4 ||
+        strcmp(object, "matrix") != 0 || strcmp(format, "coordinate") != 0 || strcmp(symmetry, "general") != 0 ||
+        (strcmp(field, "integer") != 0 && strcmp(field, "pattern") != 0))
+    {
+        printf("Error: %s is not a general integer MatrixMarket coordinate file\n", filename);
+        fclose(file);
+        return NULL;
+    }
+    *pattern = strcmp(field, "pattern") == 0;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (line[0] == '%' || line[0] == '\n')
+        {
+            continue;
+        }
+        if (sscanf(line, "%d %d %lld", rows, cols, entries) == 3)
+        {
+            return file;
+        }
+        break;
+    }
+    // Comment lines until the size line
+
+    printf("Error: %s has no MatrixMarket size line\n", filename);
+    fclose(file);
+    return NULL;
+}
+
+int coordinateMatrixDimensions(const char *filename, int *rows, int *cols)
+{
+    // Function to read the size of a MatrixMarket matrix
+    // Returns 0 on success, -1 on error
+
+    long long entries;
+    int pattern;
+    FILE *file = openCoordinateMatrix(filename, rows, cols, &entries, &pattern);
+    if (file == NULL)
+    {
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+int readCoordinateBlock(const char *filename, Matrix *block, int rowStart, int colStart)
+{
+    // Function to fill a block of a matrix from the entries of a MatrixMarket file
+    // Inputs:
+    // - filename: the MatrixMarket file
+    // - block: rows x cols block, zeroed; entries outside of it are skipped
+    // - rowStart, colStart: position of the block in the matrix
+    // Returns 0 on success, -1 on error
+
+    int rows, cols, pattern;
+    long long entries;
+    FILE *file = openCoordinateMatrix(filename, &rows, &cols, &entries, &pattern);
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    char line[256];
+    long long read = 0;
+    while (read < entries && fgets(line, sizeof(line), file) != NULL)
+    {
+        int row, col, value = 1;
+        int fields = sscanf(line, "%d %d %d", &row, &col, &value);
+        if (fields < (pattern ? 2 : 3) || row < 1 || row > rows || col < 1 || col > cols)
+        {
+            printf("Error: Bad entry in %s: %s", filename, line);
+            fclose(file);
+            return -1;
+        }
+        read++;
+
+        row -= rowStart + 1;
+        col -= colStart + 1;
+        if (row >= 0 && row < block->rows && col >= 0 && col < block->cols)
+        {
+            MATRIX_AT(block, row, col) += value;
+            // Entries listed twice are added up, as MatrixMarket readers usually do
+        }
+    }
+    fclose(file);
+
+    if (read < entries)
+    {
+        printf("Error: %s ends after %lld of its %lld entries\n", filename, read, entries);
+        return -1;
+    }
+    return 0;
+}
+
+int writeCoordinateMatrix(const char *filename, const Matrix *matrix)
+{
+    // Function to write the nonzero elements of a matrix as a MatrixMarket coordinate file
+    // Returns 0 on success, -1 on error
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error: Failed to create file %s\n", filename);
+        return -1;
+    }
+
+    long long entries = 0;
+    for (int row = 0; row < matrix->rows; row++)
+    {
+        const int *values = MATRIX_ROW(matrix, row);
+        for (int col = 0; col < matrix->cols; col++)
+        {
+            entries += values[col] != 0;
+        }
+    }
+
+    fputs(MATRIX_MARKET_HEADER, file);
+    fprintf(file, "%d %d %lld\n", matrix->rows, matrix->cols, entries);
+    for (int row = 0; row < matrix->rows; row++)
+    {
+        const int *values = MATRIX_ROW(matrix, row);
+        for (int col = 0; col < matrix->cols; col++)
+        {
+            if (values[col] != 0)
+            {
+                fprintf(file, "%d %d %d\n", row + 1, col + 1, values[col]);
+            }
+        }
+    }
+
+    if (fclose(file) != 0)
+    {
+        printf("Error: Failed to write file %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
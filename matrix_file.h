@@ -0,0 +1,51 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include<stdint.h>
+#include "matrix_operations.h"
+
+
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+#define MATRIX_FILE_MAGIC "MRMATRIX"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_ELEMENT_INT32 1
+
+typedef struct {
+    char magic[8];          // MATRIX_FILE_MAGIC, not NUL terminated
+    uint32_t version;
+    uint32_t elementType;   // MATRIX_ELEMENT_INT32
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t checksum;      // matrixChecksum of the elements
+    uint64_t reserved[3];   // keeps the elements 64-byte aligned in a mapping
+} MatrixFileHeader;         // followed by rows * cols native int32 elements, row-major, no padding
+
+#define MATRIX_MARKET_BANNER "%%MatrixMarket"
+#define MATRIX_MARKET_HEADER "%%MatrixMarket matrix coordinate integer general\n"
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+int isBinaryMatrixFile(const char* filename);
+uint64_t matrixChecksum(const Matrix* matrix);
+Matrix* mapBinaryMatrix(const char* filename, int* rows, int* cols);
+int writeBinaryMatrix(const char* filename, const Matrix* matrix);
+Matrix* readTextMatrix(const char* filename, int rows, int cols);
+int textMatrixDimensions(const char* filename, int* rows, int* cols);
+int isCoordinateMatrixFile(const char* filename);
+int coordinateMatrixDimensions(const char* filename, int* rows, int* cols);
+int readCoordinateBlock(const char* filename, Matrix* block, int rowStart, int colStart);
+int writeCoordinateMatrix(const char* filename, const Matrix* matrix);
+
+
+#endif
@@ -0,0 +1,609 @@
+#include "matrix_mpiio.h"
+#include "matrix_file.h"
+#include <limits.h>
+
+//----------------------------------------------------------    Collective Input    ----------------------------------------------------------//
+
+// Every rank of a communicator reads its own block of a shared matrix file with collective
+// MPI-IO, so input time no longer runs through the master. Rank 0 only reads the header
+// and broadcasts it. Binary files are read through a subarray file view straight into the
+// block. Text files are first scanned for line breaks by all ranks together, after which
+// each rank reads and parses just the bytes of its rows. The entries of a MatrixMarket file
+// are in no particular order, so every rank with a block scans the whole file and keeps the
+// entries that fall inside it.
+
+typedef struct {
+    int binary;
+    int coordinate;
+    int valid;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t checksum;
+    MPI_Offset fileSize;
+} FileMetadata;
+
+static void readFileMetadata(MPI_Comm comm, MPI_File file, int size, FileMetadata *metadata)
+{
+    // Function to read the header on rank 0 and share it with every rank of the communicator
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    memset(metadata, 0, sizeof(FileMetadata));
+
+    if (rank == 0)
+    {
+        MatrixFileHeader header;
+        memset(&header, 0, sizeof(header));
+        MPI_File_get_size(file, &metadata->fileSize);
+        int length = metadata->fileSize < (MPI_Offset)sizeof(header) ? (int)metadata->fileSize : (int)sizeof(header);
+        MPI_File_read_at(file, 0, &header, length, MPI_BYTE, MPI_STATUS_IGNORE);
+        // A short file is no binary matrix, but may still be a small MatrixMarket one
+
+        metadata->binary = memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) == 0;
+        metadata->coordinate = memcmp(&header, MATRIX_MARKET_BANNER, sizeof(MATRIX_MARKET_BANNER) - 1) == 0;
+        metadata->valid = 1;
+        if (metadata->binary)
+        {
+            metadata->rows = header.rows;
+            metadata->cols = header.cols;
+            metadata->checksum = header.checksum;
+            metadata->valid = header.version == MATRIX_FILE_VERSION && header.elementType == MATRIX_ELEMENT_INT32 &&
+                              header.rows == (uint64_t)size && header.cols == (uint64_t)size &&
+                              metadata->fileSize >= (MPI_Offset)(sizeof(header) + (size_t)size * size * sizeof(int));
+        }
+    }
+
+    MPI_Bcast(metadata, sizeof(FileMetadata), MPI_BYTE, 0, comm);
+}
+
+//--------------------------------------------------------------------//
+
+static void readBinaryBlock(MPI_File file, int size, Matrix *block, int rowStart, int colStart)
+{
+    // Function to read a block of a binary matrix file into 'block', collective
+
+    if (block->rows > 0 && block->cols > 0)
+    {
+        int sizes[2] = {size, size};
+        int subsizes[2] = {block->rows, block->cols};
+        int starts[2] = {rowStart, colStart};
+        MPI_Datatype fileType;
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_INT, &fileType);
+        MPI_Type_commit(&fileType);
+        MPI_Datatype memoryType = createMatrixBlockType(block, block->rows, block->cols);
+
+        MPI_File_set_view(file, sizeof(MatrixFileHeader), MPI_INT, fileType, "native", MPI_INFO_NULL);
+        MPI_File_read_all(file, block->data, 1, memoryType, MPI_STATUS_IGNORE);
+
+        MPI_Type_free(&fileType);
+        MPI_Type_free(&memoryType);
+    }
+    else
+    {
+        MPI_File_set_view(file, sizeof(MatrixFileHeader), MPI_INT, MPI_INT, "native", MPI_INFO_NULL);
+        MPI_File_read_all(file, NULL, 0, MPI_INT, MPI_STATUS_IGNORE);
+        // Ranks without a block still take part in the collective calls
+    }
+}
+
+static int verifyBlockChecksum(MPI_Comm comm, int size, const Matrix *block, int rowStart, int colStart, uint64_t checksum)
+{
+    // Function to check the file checksum from the blocks of all ranks, which must cover the
+    // matrix exactly once. The running sum of running sums in matrixChecksum equals the sum
+    // of every element weighted by (n - index), so each rank can add up its own share.
+    // Returns 1 if the checksum matches on every rank
+
+    uint64_t n = (uint64_t)size * size;
+    uint64_t sums[2] = {0, 0};
+    for (int row = 0; row < block->rows; row++)
+    {
+        const uint32_t *values = (const uint32_t *)MATRIX_ROW(block, row);
+        uint64_t index = (uint64_t)(rowStart + row) * size + colStart;
+        for (int col = 0; col < block->cols; col++)
+        {
+            sums[0] += values[col];
+            sums[1] += values[col] * (n - index - col);
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, sums, 2, MPI_UINT64_T, MPI_SUM, comm);
+
+    return ((sums[1] << 32) ^ sums[0]) == checksum;
+}
+
+//--------------------------------------------------------------------//
+
+static void readBytesCollective(MPI_Comm comm, MPI_File file, MPI_Offset offset, char *buffer, MPI_Offset length)
+{
+    // Function to read 'length' bytes at 'offset' on every rank of a communicator, collective
+    // MPI counts are int, so the bytes are read in rounds of at most INT_MAX each. Every rank
+    // joins as many rounds as the rank with the most bytes needs, reading nothing once it is done.
+
+    MPI_Offset longest = length;
+    MPI_Allreduce(MPI_IN_PLACE, &longest, 1, MPI_OFFSET, MPI_MAX, comm);
+
+    for (MPI_Offset done = 0; done < longest; done += INT_MAX)
+    {
+        MPI_Offset remaining = length > done ? length - done : 0;
+        int count = remaining < INT_MAX ? (int)remaining : INT_MAX;
+        MPI_File_read_at_all(file, offset + done, buffer + (count > 0 ? done : 0), count, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+}
+
+static void textRowOffsets(MPI_Comm comm, MPI_File file, MPI_Offset fileSize, int size, MPI_Offset *offsets)
+{
+    // Function to find where each of the first 'size' lines of a text file starts, collective
+    // Every rank scans an equal share of the file for line breaks and the positions are
+    // gathered on all ranks. offsets[size] is the end of the last row.
+
+    int rank, ranks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranks);
+
+    MPI_Offset begin = fileSize * rank / ranks;
+    MPI_Offset end = fileSize * (rank + 1) / ranks;
+    MPI_Offset length = end - begin;
+
+    char *buffer = (char *)malloc((size_t)length + 1);
+    MPI_File_set_view(file, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+    readBytesCollective(comm, file, begin, buffer, length);
+
+    int found = 0;
+    for (MPI_Offset c = 0; c < length; c++)
+    {
+        found += buffer[c] == '\n';
+    }
+    long long *breaks = (long long *)malloc((found + 1) * sizeof(long long));
+    found = 0;
+    for (MPI_Offset c = 0; c < length; c++)
+    {
+        if (buffer[c] == '\n')
+        {
+            breaks[found++] = begin + c + 1;
+            // The next line starts right after the line break
+        }
+    }
+    free(buffer);
+    // Counted first, so the positions take room for the lines only rather than for every byte
+
+    int *counts = (int *)malloc(ranks * sizeof(int));
+    int *displs = (int *)malloc(ranks * sizeof(int));
+    MPI_Allgather(&found, 1, MPI_INT, counts, 1, MPI_INT, comm);
+    int total = 0;
+    for (int r = 0; r < ranks; r++)
+    {
+        displs[r] = total;
+        total += counts[r];
+    }
+
+    long long *allBreaks = (long long *)malloc((total + 1) * sizeof(long long));
+    MPI_Allgatherv(breaks, found, MPI_LONG_LONG, allBreaks, counts, displs, MPI_LONG_LONG, comm);
+
+    offsets[0] = 0;
+    for (int row = 1; row <= size; row++)
+    {
+        offsets[row] = row <= total ? allBreaks[row - 1] : fileSize;
+        // A missing final line break ends the last row at the end of the file
+    }
+
+    free(breaks);
+    free(allBreaks);
+    free(counts);
+    free(displs);
+}
+
+static void readTextBlock(MPI_Comm comm, MPI_File file, MPI_Offset fileSize, int size, Matrix *block, int rowStart, int colStart)
+{
+    // Function to read and parse a block of a text matrix file into 'block', collective
+    // The whole rows of the block are read, the values outside its columns are skipped
+
+    MPI_Offset *offsets = (MPI_Offset *)malloc((size + 1) * sizeof(MPI_Offset));
+    textRowOffsets(comm, file, fileSize, size, offsets);
+
+    MPI_Offset first = block->rows > 0 ? offsets[rowStart] : 0;
+    MPI_Offset length = block->rows > 0 ? offsets[rowStart + block->rows] - first : 0;
+    char *buffer = (char *)malloc((size_t)length + 1);
+    readBytesCollective(comm, file, first, buffer, length);
+    buffer[length] = '\0';
+
+    for (int row = 0; row < block->rows; row++)
+    {
+        char *position = buffer + (offsets[rowStart + row] - first);
+        char *lineEnd = buffer + (offsets[rowStart + row + 1] - first);
+        int *values = MATRIX_ROW(block, row);
+        int col = 0;
+
+        while (position < lineEnd && col < colStart + block->cols)
+        {
+            while (position < lineEnd && (*position == ' ' || *position == '\t' || *position == '\r'))
+            {
+                position++;
+            }
+            if (position >= lineEnd || *position == '\n')
+            {
+                break;
+            }
+
+            char *next;
+            long value = strtol(position, &next, 10);
+            if (next == position)
+            {
+                break;
+            }
+            if (col >= colStart)
+            {
+                values[col - colStart] = (int)value;
+            }
+            col++;
+            position = next;
+        }
+        // Missing values stay zero, as in readTextMatrix
+    }
+
+    free(buffer);
+    free(offsets);
+}
+
+//--------------------------------------------------------------------//
+
+Matrix *readMatrixBlockCollective(MPI_Comm comm, char *filename, int size, int rowStart, int rows, int colStart, int cols)
+{
+    // Function to read one block of a size x size matrix file on every rank of a communicator
+    // Inputs:
+    // - comm: all ranks of it must call, ranks without a block pass rows = 0
+    // - filename: text or binary matrix file, visible to every rank
+    // - size: size of the matrix
+    // - rowStart, rows, colStart, cols: the block this rank reads; for binary files the
+    //   blocks of all ranks must cover the matrix exactly once so the checksum can be checked
+    // Returns the rows x cols block
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_File file;
+    if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+        {
+            printf("Error: Failed to open file %s\n", filename);
+        }
+        exit(1);
+    }
+
+    FileMetadata metadata;
+    readFileMetadata(comm, file, size, &metadata);
+    if (!metadata.valid)
+    {
+        if (rank == 0)
+        {
+            printf("Error: %s is not a valid %d x %d binary matrix file\n", filename, size, size);
+        }
+        exit(1);
+    }
+
+    Matrix *block = allocateMatrix(rows, cols);
+
+    if (metadata.binary)
+    {
+        readBinaryBlock(file, size, block, rowStart, colStart);
+        if (!verifyBlockChecksum(comm, size, block, rowStart, colStart, metadata.checksum))
+        {
+            if (rank == 0)
+            {
+                printf("Error: Checksum mismatch in %s\n", filename);
+            }
+            exit(1);
+        }
+    }
+    else if (metadata.coordinate)
+    {
+        int rowsInFile = 0, colsInFile = 0;
+        int failed = rows > 0 && cols > 0 &&
+                     (coordinateMatrixDimensions(filename, &rowsInFile, &colsInFile) != 0 || rowsInFile != size || colsInFile != size ||
+                      readCoordinateBlock(filename, block, rowStart, colStart) != 0);
+        MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, comm);
+        if (failed)
+        {
+            if (rank == 0)
+            {
+                printf("Error: %s is not a valid %d x %d MatrixMarket file\n", filename, size, size);
+            }
+            exit(1);
+        }
+    }
+    else
+    {
+        readTextBlock(comm, file, metadata.fileSize, size, block, rowStart, colStart);
+    }
+
+    MPI_File_close(&file);
+    return block;
+}
+
+
+//----------------------------------------------------------    Collective Output    ----------------------------------------------------------//
+
+// Every rank writes the output cells it holds straight into the shared result file at their
+// final offsets with one collective write, and rank 0 only learns how many cells were written.
+// The cells of a rank are described as segments of rows, which covers both a reducer's run
+// of keys and a grid process's block. In the text format every value is padded to the same
+// width, agreed on by all ranks, so the offset of each cell is known up front.
+
+static int decimalWidth(int value)
+{
+    char digits[16];
+    return sprintf(digits, "%d", value);
+}
+
+static MPI_Offset textCellOffset(int size, int width, int row, int col)
+{
+    return (MPI_Offset)row * ((MPI_Offset)size * width + 1) + (MPI_Offset)col * width;
+}
+
+static void writeBytesCollective(MPI_Comm comm, MPI_File file, MPI_Offset offset, const char *buffer, MPI_Offset length)
+{
+    // Function to write 'length' bytes at 'offset' on every rank of a communicator, collective
+    // In rounds of at most INT_MAX bytes, like readBytesCollective
+
+    MPI_Offset longest = length;
+    MPI_Allreduce(MPI_IN_PLACE, &longest, 1, MPI_OFFSET, MPI_MAX, comm);
+
+    for (MPI_Offset done = 0; done < longest; done += INT_MAX)
+    {
+        MPI_Offset remaining = length > done ? length - done : 0;
+        int count = remaining < INT_MAX ? (int)remaining : INT_MAX;
+        MPI_File_write_at_all(file, offset + done, buffer + (count > 0 ? done : 0), count, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+}
+
+static long long writeCoordinateSegmentsCollective(MPI_Comm comm, char *filename, int size, const RowSegment *segments, int numSegments)
+{
+    // Function to write the nonzero cells of every rank's segments as one MatrixMarket file, collective
+    // The entries may come in any order, so each rank's lines simply follow those of the ranks before it
+    // Returns the number of cells written by all ranks together on rank 0, 0 elsewhere
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    long long cells = 0;
+    long long entries = 0;
+    for (int s = 0; s < numSegments; s++)
+    {
+        for (int c = 0; c < segments[s].count; c++)
+        {
+            entries += segments[s].values[c] != 0;
+        }
+        cells += segments[s].count;
+    }
+
+    char *buffer = (char *)malloc(entries * 36 + 1);
+    char *position = buffer;
+    for (int s = 0; s < numSegments; s++)
+    {
+        for (int c = 0; c < segments[s].count; c++)
+        {
+            if (segments[s].values[c] != 0)
+            {
+                position += sprintf(position, "%d %d %d\n", segments[s].row + 1, segments[s].col + c + 1, segments[s].values[c]);
+            }
+        }
+    }
+    long long bytes = position - buffer;
+    // Three numbers of up to 11 characters each, two spaces and a line break per entry
+
+    long long totals[2] = {entries, bytes};
+    MPI_Allreduce(MPI_IN_PLACE, totals, 2, MPI_LONG_LONG, MPI_SUM, comm);
+    long long before = 0;
+    MPI_Exscan(&bytes, &before, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0)
+    {
+        before = 0;
+    }
+    // MPI_Exscan leaves rank 0's result undefined
+
+    char header[160];
+    int headerLength = sprintf(header, "%s%d %d %lld\n", MATRIX_MARKET_HEADER, size, size, totals[0]);
+    // Every rank formats the same header, so every rank knows where the entries start
+
+    MPI_File file;
+    if (MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+        {
+            printf("Error: Failed to create file %s\n", filename);
+        }
+        exit(1);
+    }
+    MPI_File_set_size(file, headerLength + totals[1]);
+
+    if (rank == 0)
+    {
+        MPI_File_write_at(file, 0, header, headerLength, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    writeBytesCollective(comm, file, headerLength + before, buffer, bytes);
+    MPI_File_close(&file);
+    free(buffer);
+
+    long long written = 0;
+    MPI_Reduce(&cells, &written, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    return written;
+}
+
+static long long writeSegmentsCollective(MPI_Comm comm, char *filename, int size, MatrixFileFormat format, const RowSegment *segments, int numSegments)
+{
+    // Function to write every rank's segments of a size x size matrix into one file, collective
+    // Returns the number of cells written by all ranks together on rank 0, 0 elsewhere
+
+    if (format == FORMAT_COORDINATE)
+    {
+        return writeCoordinateSegmentsCollective(comm, filename, size, segments, numSegments);
+    }
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    long long cells = 0;
+    int width = 1;
+    uint64_t n = (uint64_t)size * size;
+    uint64_t sums[2] = {0, 0};
+    for (int s = 0; s < numSegments; s++)
+    {
+        uint64_t index = (uint64_t)segments[s].row * size + segments[s].col;
+        for (int c = 0; c < segments[s].count; c++)
+        {
+            int value = segments[s].values[c];
+            int digits = decimalWidth(value);
+            width = digits > width ? digits : width;
+            sums[0] += (uint32_t)value;
+            sums[1] += (uint32_t)value * (n - index - c);
+        }
+        cells += segments[s].count;
+    }
+
+    if (format == FORMAT_BINARY)
+    {
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : sums, sums, 2, MPI_UINT64_T, MPI_SUM, 0, comm);
+        // Same decomposition of the checksum as on input
+    }
+    else
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &width, 1, MPI_INT, MPI_MAX, comm);
+        width++;
+        // Widest value plus one separating space, the same on every rank
+    }
+
+    MPI_File file;
+    if (MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+        {
+            printf("Error: Failed to create file %s\n", filename);
+        }
+        exit(1);
+    }
+
+    MPI_Offset fileSize = format == FORMAT_BINARY ? (MPI_Offset)(sizeof(MatrixFileHeader) + (size_t)n * sizeof(int))
+                                                  : (MPI_Offset)textCellOffset(size, width, size, 0);
+    MPI_File_set_size(file, fileSize);
+    // Drops whatever an older, longer file had past the end
+
+    if (format == FORMAT_BINARY && rank == 0)
+    {
+        MatrixFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+        header.version = MATRIX_FILE_VERSION;
+        header.elementType = MATRIX_ELEMENT_INT32;
+        header.rows = size;
+        header.cols = size;
+        header.checksum = (sums[1] << 32) ^ sums[0];
+        MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    int *lengths = (int *)malloc((numSegments + 1) * sizeof(int));
+    MPI_Aint *displacements = (MPI_Aint *)malloc((numSegments + 1) * sizeof(MPI_Aint));
+    int bytes = 0;
+    for (int s = 0; s < numSegments; s++)
+    {
+        if (format == FORMAT_BINARY)
+        {
+            displacements[s] = (MPI_Aint)sizeof(MatrixFileHeader) + ((MPI_Aint)segments[s].row * size + segments[s].col) * (MPI_Aint)sizeof(int);
+            lengths[s] = segments[s].count * sizeof(int);
+        }
+        else
+        {
+            displacements[s] = (MPI_Aint)textCellOffset(size, width, segments[s].row, segments[s].col);
+            lengths[s] = segments[s].count * width + (segments[s].col + segments[s].count == size ? 1 : 0);
+            // A segment that ends the row also writes the line break
+        }
+        bytes += lengths[s];
+    }
+
+    char *buffer = (char *)malloc(bytes + 1);
+    char *position = buffer;
+    for (int s = 0; s < numSegments; s++)
+    {
+        if (format == FORMAT_BINARY)
+        {
+            memcpy(position, segments[s].values, segments[s].count * sizeof(int));
+            position += segments[s].count * sizeof(int);
+            continue;
+        }
+        for (int c = 0; c < segments[s].count; c++)
+        {
+            position += sprintf(position, "%*d ", width - 1, segments[s].values[c]);
+        }
+        if (segments[s].col + segments[s].count == size)
+        {
+            *position++ = '\n';
+        }
+    }
+    // Cells in file order, already formatted
+
+    MPI_Datatype fileType = MPI_BYTE;
+    if (numSegments > 0)
+    {
+        MPI_Type_create_hindexed(numSegments, lengths, displacements, MPI_BYTE, &fileType);
+        MPI_Type_commit(&fileType);
+    }
+    MPI_File_set_view(file, 0, MPI_BYTE, fileType, "native", MPI_INFO_NULL);
+    MPI_File_write_all(file, buffer, bytes, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    if (numSegments > 0)
+    {
+        MPI_Type_free(&fileType);
+    }
+    free(buffer);
+    free(lengths);
+    free(displacements);
+
+    long long written = 0;
+    MPI_Reduce(&cells, &written, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    // The only thing rank 0 collects is the completion count
+    return written;
+}
+
+long long writeMatrixRangeCollective(MPI_Comm comm, char *filename, int size, MatrixFileFormat format, int firstKey, int numKeys, const int *values)
+{
+    // Function to write a run of output cells, keys firstKey .. firstKey + numKeys in row-major
+    // order, into the result file, collective over 'comm'
+    // Returns the number of cells written by all ranks together on rank 0
+
+    int numSegments = 0;
+    RowSegment *segments = (RowSegment *)malloc((size + 2) * sizeof(RowSegment));
+    for (int q = firstKey; q < firstKey + numKeys; q += segments[numSegments++].count)
+    {
+        segments[numSegments].row = q / size;
+        segments[numSegments].col = q % size;
+        segments[numSegments].count = size - q % size < firstKey + numKeys - q ? size - q % size : firstKey + numKeys - q;
+        segments[numSegments].values = &values[q - firstKey];
+    }
+    // A run of keys is a partial first row, whole rows, then a partial last row
+
+    long long written = writeSegmentsCollective(comm, filename, size, format, segments, numSegments);
+    free(segments);
+    return written;
+}
+
+long long writeMatrixBlockCollective(MPI_Comm comm, char *filename, int size, MatrixFileFormat format, int rowStart, int rows, int colStart, int cols, const int *values, int ld)
+{
+    // Function to write a rows x cols block starting at (rowStart, colStart) into the result
+    // file, collective over 'comm'. Row r of the block is values[r * ld .. r * ld + cols).
+    // Returns the number of cells written by all ranks together on rank 0
+
+    int numSegments = cols > 0 ? rows : 0;
+    RowSegment *segments = (RowSegment *)malloc((numSegments + 1) * sizeof(RowSegment));
+    for (int r = 0; r < numSegments; r++)
+    {
+        segments[r].row = rowStart + r;
+        segments[r].col = colStart;
+        segments[r].count = cols;
+        segments[r].values = &values[(size_t)r * ld];
+    }
+
+    long long written = writeSegmentsCollective(comm, filename, size, format, segments, numSegments);
+    free(segments);
+    return written;
+}
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
@@ -0,0 +1,33 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef MATRIX_MPIIO_H
+#define MATRIX_MPIIO_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+typedef struct {
+    int row;
+    int col;                // first column of the segment
+    int count;              // cells in the segment, all in the same row
+    const int* values;
+} RowSegment;
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+Matrix* readMatrixBlockCollective(MPI_Comm comm, char* filename, int size, int rowStart, int rows, int colStart, int cols);
+long long writeMatrixRangeCollective(MPI_Comm comm, char* filename, int size, MatrixFileFormat format, int firstKey, int numKeys, const int* values);
+long long writeMatrixBlockCollective(MPI_Comm comm, char* filename, int size, MatrixFileFormat format, int rowStart, int rows, int colStart, int cols, const int* values, int ld);
+
+
+#endif
@@ -1,16 +1,27 @@
 #include "matrix_operations.h"
+#include "intermediate_store.h"
+#include "gemm_kernel.h"
+#include "matrix_file.h"
+#include "matrix_mpiio.h"
+#include "rma_input.h"
+#include "phase_timer.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/mman.h>
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 //Reads command line arguments
 
-int readCommandLineArguments(int argc, char **argv, char **inputFile1, char **inputFile2, int *MatrixSize)
+int readCommandLineArguments(int argc, char **argv, char **inputFile1, char **inputFile2, int *MatrixSize, JobOptions *options)
 {
     if (argc < 4)
     {
         printf("Insufficient command line arguments.\n");
+        printf("Usage: %s <matrixA> <matrixB> <size> [--engine=mapreduce|summa|cannon] [--panel-width=<cols>] [--threads=<count>] [--batch-size=<pairs>] [--shuffle=master|direct|stream] [--stream-window=<messages>] [--schedule=static|dynamic] [--task-rows=<rows>] [--task-keys=<cells>] [--memory-budget=<MB>] [--scratch-dir=<path>] [--map-mode=row|outer] [--huge-pages] [--output-format=text|binary|coordinate] [--sparse] [--input=collective|master|shared|rma] [--output=collective|master] [--timings=<file>] [--verify=freivalds|exact] [--verify-rounds=<count>]\n", argv[0]);
         return -1;
     }
 
@@ -24,138 +35,514 @@ int readCommandLineArguments(int argc, char **argv, char **inputFile1, char **in
         return -1;
     }
 
+    options->engine = ENGINE_MAPREDUCE;
+    options->panelWidth = 64;
+    options->batchSize = 0;
+    options->threads = 1;
+    options->shuffle = SHUFFLE_MASTER;
+    options->mapMode = MAP_ROW;
+    options->memoryBudgetMB = 1024;
+    options->scratchDir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    options->hugePages = 0;
+    options->outputFormat = FORMAT_TEXT;
+    options->input = INPUT_COLLECTIVE;
+    options->output = OUTPUT_COLLECTIVE;
+    options->streamWindow = 4;
+    options->schedule = SCHEDULE_STATIC;
+    options->taskRows = 0;
+    options->taskKeys = 0;
+    options->sparse = 0;
+    options->timingsFile = NULL;
+    options->verify = VERIFY_FREIVALDS;
+    options->verifyRounds = 8;
+
+    // Optional flags follow the three positional arguments
+    for (int arg = 4; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--engine=mapreduce") == 0)
+        {
+            options->engine = ENGINE_MAPREDUCE;
+        }
+        else if (strcmp(argv[arg], "--engine=summa") == 0)
+        {
+            options->engine = ENGINE_SUMMA;
+        }
+        else if (strcmp(argv[arg], "--engine=cannon") == 0)
+        {
+            options->engine = ENGINE_CANNON;
+        }
+        else if (strncmp(argv[arg], "--panel-width=", 14) == 0)
+        {
+            options->panelWidth = atoi(argv[arg] + 14);
+            if (options->panelWidth <= 0)
+            {
+                printf("Invalid panel width. Please provide a positive integer.\n");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "--threads=", 10) == 0)
+        {
+            options->threads = atoi(argv[arg] + 10);
+            if (options->threads <= 0)
+            {
+                printf("Invalid thread count. Please provide a positive integer.\n");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "--batch-size=", 13) == 0)
+        {
+            options->batchSize = atoi(argv[arg] + 13);
+            if (options->batchSize <= 0)
+            {
+                printf("Invalid batch size. Please provide a positive integer.\n");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "--memory-budget=", 16) == 0)
+        {
+            options->memoryBudgetMB = atol(argv[arg] + 16);
+            if (options->memoryBudgetMB <= 0)
+            {
+                printf("Invalid memory budget. Please provide a positive number of megabytes.\n");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "--scratch-dir=", 14) == 0)
+        {
+            options->scratchDir = argv[arg] + 14;
+        }
+        else if (strcmp(argv[arg], "--map-mode=row") == 0)
+        {
+            options->mapMode = MAP_ROW;
+        }
+        else if (strcmp(argv[arg], "--map-mode=outer") == 0)
+        {
+            options->mapMode = MAP_OUTER;
+        }
+        else if (strcmp(argv[arg], "--shuffle=master") == 0)
+        {
+            options->shuffle = SHUFFLE_MASTER;
+        }
+        else if (strcmp(argv[arg], "--shuffle=direct") == 0)
+        {
+            options->shuffle = SHUFFLE_DIRECT;
+        }
+        else if (strcmp(argv[arg], "--shuffle=stream") == 0)
+        {
+            options->shuffle = SHUFFLE_STREAM;
+        }
+        else if (strncmp(argv[arg], "--stream-window=", 16) == 0)
+        {
+            options->streamWindow = atoi(argv[arg] + 16);
+            if (options->streamWindow <= 0)
+            {
+                printf("Invalid stream window. Please provide a positive number of messages.\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[arg], "--schedule=static") == 0)
+        {
+            options->schedule = SCHEDULE_STATIC;
+        }
+        else if (strcmp(argv[arg], "--schedule=dynamic") == 0)
+        {
+            options->schedule = SCHEDULE_DYNAMIC;
+        }
+        else if (strncmp(argv[arg], "--task-rows=", 12) == 0)
+        {
+            options->taskRows = atoi(argv[arg] + 12);
+            if (options->taskRows <= 0)
+            {
+                printf("Invalid task size. Please provide a positive number of rows.\n");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[arg], "--task-keys=", 12) == 0)
+        {
+            options->taskKeys = atoi(argv[arg] + 12);
+            if (options->taskKeys <= 0)
+            {
+                printf("Invalid task size. Please provide a positive number of output cells.\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[arg], "--huge-pages") == 0)
+        {
+            options->hugePages = 1;
+        }
+        else if (strcmp(argv[arg], "--output-format=text") == 0)
+        {
+            options->outputFormat = FORMAT_TEXT;
+        }
+        else if (strcmp(argv[arg], "--output-format=binary") == 0)
+        {
+            options->outputFormat = FORMAT_BINARY;
+        }
+        else if (strcmp(argv[arg], "--output-format=coordinate") == 0)
+        {
+            options->outputFormat = FORMAT_COORDINATE;
+        }
+        else if (strcmp(argv[arg], "--sparse") == 0)
+        {
+            options->sparse = 1;
+        }
+        else if (strncmp(argv[arg], "--timings=", 10) == 0)
+        {
+            options->timingsFile = argv[arg] + 10;
+        }
+        else if (strcmp(argv[arg], "--verify=freivalds") == 0)
+        {
+            options->verify = VERIFY_FREIVALDS;
+        }
+        else if (strcmp(argv[arg], "--verify=exact") == 0)
+        {
+            options->verify = VERIFY_EXACT;
+        }
+        else if (strncmp(argv[arg], "--verify-rounds=", 16) == 0)
+        {
+            options->verifyRounds = atoi(argv[arg] + 16);
+            if (options->verifyRounds <= 0)
+            {
+                printf("Invalid number of rounds. Please provide a positive integer.\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[arg], "--input=collective") == 0)
+        {
+            options->input = INPUT_COLLECTIVE;
+        }
+        else if (strcmp(argv[arg], "--input=master") == 0)
+        {
+            options->input = INPUT_MASTER;
+        }
+        else if (strcmp(argv[arg], "--input=shared") == 0)
+        {
+            options->input = INPUT_SHARED;
+        }
+        else if (strcmp(argv[arg], "--input=rma") == 0)
+        {
+            options->input = INPUT_RMA;
+        }
+        else if (strcmp(argv[arg], "--output=collective") == 0)
+        {
+            options->output = OUTPUT_COLLECTIVE;
+        }
+        else if (strcmp(argv[arg], "--output=master") == 0)
+        {
+            options->output = OUTPUT_MASTER;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[arg]);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
-//----------------------------------------------------------    Matrix Operations    ----------------------------------------------------------//
+// Sets how many threads each rank runs its map, reduce and multiply loops on, and picks the local kernels.
+// Without OpenMP, or when MPI cannot hand calls over from the main thread, ranks stay single-threaded.
 
-void fillMatrixWithZeros(int **matrix, int size, int row)
+int configureThreads(int threads, int providedThreadLevel)
 {
-    if (row >= size)
+    selectGemmKernel();   // before any thread runs a block product or dot product
+
+#ifdef _OPENMP
+    if (providedThreadLevel < MPI_THREAD_FUNNELED)
     {
-        return; // Base case: all rows have been filled
+        threads = 1;
     }
-    memset(matrix[row], 0, size * sizeof(int));
-    fillMatrixWithZeros(matrix, size, row + 1); // Recursive call to fill the next row
+    omp_set_num_threads(threads);
+    return threads;
+#else
+    (void)threads;
+    (void)providedThreadLevel;
+    return 1;
+#endif
+}
+
+int rankThreadCount(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Returns the calling thread's index, below rankThreadCount(), to pick its own slice of per-thread buffers
+
+int rankThreadIndex(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
 }
 
-// Allocates memory for a matrix of size x size
+// Returns the number of key-value pairs a mapper packs into one message.
+// The default ships every pair produced from one matrix row (2 * size * size) together, up to
+// DEFAULT_BATCH_PAIRS. Past that a row goes out in several messages, so a batch buffer stays near
+// 5 MB whatever the size, where a whole row would take 670 MB at size 4096 and overflow int at 32768.
 
-int **allocateMatrix(int size)
+#define DEFAULT_BATCH_PAIRS (1 << 18)
+
+int resolveBatchSize(const JobOptions *options, int size)
 {
-    int **matrix = (int **)malloc(size * sizeof(int *));
-    for (int row = 0; row < size; row++)
+    if (options->batchSize > 0)
     {
-        matrix[row] = (int *)malloc(size * sizeof(int));
+        return options->batchSize;
     }
-    return matrix;
+    long long rowPairs = 2LL * size * size;
+    return rowPairs < DEFAULT_BATCH_PAIRS ? (int)rowPairs : DEFAULT_BATCH_PAIRS;
 }
 
-// Allocates memory for a matrix of size x size and fills it with random numbers
+//----------------------------------------------------------    Matrix Operations    ----------------------------------------------------------//
+
+// Every matrix is one row-major allocation aligned to 64 bytes, with each row padded to a
+// multiple of 16 ints so rows start on a cache line and a block of rows or columns can be
+// described to MPI as a single strided datatype. With huge pages enabled the allocation is
+// taken from an explicit huge-page mapping, or failing that, aligned to a huge page and
+// offered to transparent huge pages.
 
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
-int **readMatrixFromFile(char *filename, int size)
+static int useHugePages = 0;
+
+void setMatrixHugePages(int enabled)
 {
-    int **matrix = allocateMatrix(size);
-    fillMatrixWithZeros(matrix, size, 0);
+    useHugePages = enabled;
+}
 
-    FILE *file = fopen(filename, "r");
-    if (file == NULL)
+Matrix *allocateMatrix(int rows, int cols)
+{
+    // Function to allocate a zero-filled rows x cols matrix
+    // Inputs:
+    // - rows, cols: dimensions of the matrix
+
+    Matrix *matrix = (Matrix *)malloc(sizeof(Matrix));
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->stride = cols > 0 ? (cols + 15) / 16 * 16 : 16;
+    matrix->bytes = (size_t)(rows > 0 ? rows : 1) * matrix->stride * sizeof(int);
+    matrix->data = NULL;
+    matrix->mapping = NULL;
+
+#ifdef MAP_HUGETLB
+    if (useHugePages)
     {
-        printf("Error: Failed to open file %s\n", filename);
-        return NULL;
+        size_t length = (matrix->bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED)
+        {
+            matrix->data = (int *)mapping;
+            matrix->bytes = length;
+            matrix->mapping = mapping;
+            return matrix;
+            // Anonymous mappings arrive zero-filled
+        }
     }
+#endif
 
-    char buffer[100]; // Assuming a maximum line length of 100 characters
-
-    int row = 0;
-    while (fgets(buffer, sizeof(buffer), file) != NULL)
+    void *memory = NULL;
+    size_t alignment = useHugePages ? HUGE_PAGE_SIZE : MATRIX_ALIGNMENT;
+    if (posix_memalign(&memory, alignment, matrix->bytes) != 0)
+    {
+        printf("Error: Failed to allocate a %d x %d matrix\n", rows, cols);
+        exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (useHugePages)
     {
-        int col = 0;
-        int length = strlen(buffer);
+        madvise(memory, matrix->bytes, MADV_HUGEPAGE);
+        // No huge pages reserved, ask for transparent ones instead
+    }
+#endif
+    matrix->data = (int *)memory;
+    fillMatrixWithZeros(matrix);
+    return matrix;
+}
 
-        if (buffer[length - 1] == '\n')
-        {
-            buffer[length - 1] = '\0';
-        }
+void fillMatrixWithZeros(Matrix *matrix)
+{
+    memset(matrix->data, 0, matrix->bytes);
+}
 
-        char *token = strtok(buffer, " \t");
+// Reads a size x size matrix, binary files are mapped, text and MatrixMarket files parsed
 
-        while (token != NULL)
+Matrix *readMatrixFromFile(char *filename, int size)
+{
+    if (isCoordinateMatrixFile(filename))
+    {
+        int rows, cols;
+        if (coordinateMatrixDimensions(filename, &rows, &cols) != 0)
+        {
+            return NULL;
+        }
+        if (rows != size || cols != size)
+        {
+            printf("Error: %s holds a %d x %d matrix, expected %d x %d\n", filename, rows, cols, size, size);
+            return NULL;
+        }
+        Matrix *matrix = allocateMatrix(size, size);
+        if (readCoordinateBlock(filename, matrix, 0, 0) != 0)
         {
-            matrix[row][col] = atoi(token);
-            col++;
-            token = strtok(NULL, " \t");
+            freeMatrix(matrix);
+            return NULL;
         }
+        return matrix;
+    }
+    if (!isBinaryMatrixFile(filename))
+    {
+        return readTextMatrix(filename, size, size);
+    }
 
-        row++;
+    int rows, cols;
+    Matrix *matrix = mapBinaryMatrix(filename, &rows, &cols);
+    if (matrix != NULL && (rows != size || cols != size))
+    {
+        printf("Error: %s holds a %d x %d matrix, expected %d x %d\n", filename, rows, cols, size, size);
+        freeMatrix(matrix);
+        return NULL;
     }
-    fclose(file);
     return matrix;
 }
 
 // Frees memory allocated for a matrix
 
-void freeMatrix(int **matrix, int size)
+void freeMatrix(Matrix *matrix)
 {
-    for (int row = 0; row < size; row++)
+    if (matrix == NULL)
+    {
+        return;
+    }
+    if (matrix->mapping != NULL)
     {
-        free(matrix[row]);
+        munmap(matrix->mapping, matrix->bytes);
     }
+    else if (matrix->bytes > 0)
+    {
+        free(matrix->data);
+    }
+    // Views into shared memory only own the Matrix itself
     free(matrix);
 }
 
+// Returns a committed datatype covering a rows x cols block of the matrix, to be sent from or
+// received into the address of the block's first element. Blocks of the same shape match each
+// other whatever the strides of the two matrices.
+
+MPI_Datatype createMatrixBlockType(const Matrix *matrix, int rows, int cols)
+{
+    MPI_Datatype blockType;
+    MPI_Type_vector(rows, cols, matrix->stride, MPI_INT, &blockType);
+    MPI_Type_commit(&blockType);
+    return blockType;
+}
+
 //mustiplies two matrices and stores the result in result matrix
+//The rows are already contiguous and aligned, so the blocked, vectorised kernel runs on them directly
 
-void multiplyMatrices(int **result, int **matrix1, int **matrix2, int size)
+void multiplyMatrices(Matrix *result, const Matrix *matrix1, const Matrix *matrix2)
 {
-    for (int row = 0; row < size; row++)
-    {
-        for (int col = 0; col < size; col++)
-        {
-            result[row][col] = 0;
-            for (int k = 0; k < size; k++)
-            {
-                result[row][col] += matrix1[row][k] * matrix2[k][col];
-            }
-        }
-    }
+    fillMatrixWithZeros(result);
+    gemmAccumulate(matrix1->rows, matrix2->cols, matrix1->cols, matrix1->data, matrix1->stride,
+                   matrix2->data, matrix2->stride, result->data, result->stride);
 }
 
 //compares two matrices and returns true if they are equal
 
 bool compareMatrices(char *file1, char *file2, char *file3, int size)
 {
-    int **expectedMatrix = readMatrixFromFile(file3, size);
-    int **matrixA = readMatrixFromFile(file1, size);
-    int **matrixB = readMatrixFromFile(file2, size);
+    Matrix *expectedMatrix = readMatrixFromFile(file3, size);
+    Matrix *matrixA = readMatrixFromFile(file1, size);
+    Matrix *matrixB = readMatrixFromFile(file2, size);
 
-    int **multipliedMatrix = allocateMatrix(size);
-    multiplyMatrices(multipliedMatrix, matrixA, matrixB, size);
+    if (expectedMatrix == NULL || matrixA == NULL || matrixB == NULL)
+    {
+        freeMatrix(expectedMatrix);
+        freeMatrix(matrixA);
+        freeMatrix(matrixB);
+        return false;
+    }
+
+    Matrix *multipliedMatrix = allocateMatrix(size, size);
+    multiplyMatrices(multipliedMatrix, matrixA, matrixB);
 
-    int row, col;
     bool equal = true;
 
-    for (row = 0; row < size && equal; row++)
+    for (int row = 0; row < size && equal; row++)
     {
-        for (col = 0; col < size; col++)
+        if (memcmp(MATRIX_ROW(expectedMatrix, row), MATRIX_ROW(multipliedMatrix, row), size * sizeof(int)) != 0)
         {
-            if (expectedMatrix[row][col] != multipliedMatrix[row][col])
-            {
-                equal = false;
-                break;
-            }
+            equal = false;
         }
     }
 
-    freeMatrix(expectedMatrix, size);
-    freeMatrix(multipliedMatrix, size);
-    freeMatrix(matrixA, size);
-    freeMatrix(matrixB, size);
+    freeMatrix(expectedMatrix);
+    freeMatrix(multipliedMatrix);
+    freeMatrix(matrixA);
+    freeMatrix(matrixB);
 
     return equal;
 }
 
+//Splits 'total' items into 'parts' contiguous blocks whose lengths differ by at most one
+
+int blockStart(int index, int parts, int total)
+{
+    int base = total / parts;
+    int remainder = total % parts;
+    return index * base + (index < remainder ? index : remainder);
+}
+
+int blockLength(int index, int parts, int total)
+{
+    return total / parts + (index < total % parts ? 1 : 0);
+}
+
+int blockOwner(int position, int parts, int total)
+{
+    int base = total / parts;
+    int remainder = total % parts;
+    if (position < remainder * (base + 1))
+    {
+        return position / (base + 1);
+    }
+    return remainder + (position - remainder * (base + 1)) / base;
+}
+
+//Copies the block [rowStart, rowStart + rows) x [colStart, colStart + cols) of a matrix
+//into a contiguous row-major buffer. Cells outside the matrix are filled with zeros.
+
+void packMatrixBlock(const Matrix *matrix, int rowStart, int rows, int colStart, int cols, int *buffer)
+{
+    for (int row = 0; row < rows; row++)
+    {
+        for (int col = 0; col < cols; col++)
+        {
+            int r = rowStart + row;
+            int c = colStart + col;
+            buffer[(size_t)row * cols + col] = (r < matrix->rows && c < matrix->cols) ? MATRIX_AT(matrix, r, c) : 0;
+        }
+    }
+}
+
+//Copies a contiguous block back into a matrix, cells outside the matrix are dropped
+
+void unpackMatrixBlock(Matrix *matrix, const int *buffer, int rowStart, int rows, int colStart, int cols)
+{
+    for (int row = 0; row < rows && rowStart + row < matrix->rows; row++)
+    {
+        for (int col = 0; col < cols && colStart + col < matrix->cols; col++)
+        {
+            MATRIX_AT(matrix, rowStart + row, colStart + col) = buffer[(size_t)row * cols + col];
+        }
+    }
+}
+
 //----------------------------------------------------------    MPI Operations    ----------------------------------------------------------//
 
 void printReducerRanks(int *reducerRanks, int numOfReducers)
@@ -178,7 +565,26 @@ void printReducerChunkSize(int reducerChunkSize)
 {
     printf("Reducer chunksize: %d\n", reducerChunkSize);
 }
-void populateMatricesFromFile(char *file1, char *file2, int size, int ***matrix1, int ***matrix2)
+void printDistribution(int Mappers, int Reducers, int size)
+{
+    int cells = size * size;
+    printf("Distribution: %d mappers with %d", Mappers, blockLength(0, Mappers, size));
+    if (size % Mappers != 0)
+    {
+        printf(" or %d", blockLength(Mappers - 1, Mappers, size));
+    }
+    printf(" rows each, %d reducers with %d", Reducers, blockLength(0, Reducers, cells));
+    if (cells % Reducers != 0)
+    {
+        printf(" or %d", blockLength(Reducers - 1, Reducers, cells));
+    }
+    printf(" output cells each\n");
+}
+void printBatchSize(int batchSize)
+{
+    printf("Mapper batch size: %d pairs\n", batchSize);
+}
+void populateMatricesFromFile(char *file1, char *file2, int size, Matrix **matrix1, Matrix **matrix2)
 {
     *matrix1 = readMatrixFromFile(file1, size);
 
@@ -192,50 +598,67 @@ void printMasterDetails(int rank, char *machineName)
 
 //sends the rows of the matrices to the mappers
 
-void sendMatrixRowsToMappers(int rank, int Mappers, int chunkSize, int size, int **matrix1, int **matrix2)
+void sendMatrixRowsToMappers(int Mappers, int size, const Matrix *matrix1, const Matrix *matrix2, MapMode mapMode)
 {
-    // Function to send matrix rows to mappers
+    // Function to send every mapper its block of matrix rows
     // Inputs:
-    // - rank: current process rank
-    // - Mappers: total number of mappers
-    // - chunkSize: number of rows assigned to each mapper
+    // - Mappers: total number of mappers, mapper i gets rows blockStart(i - 1, Mappers, size) onwards
     // - size: size of the matrix
     // - matrix1: pointer to the first matrix
     // - matrix2: pointer to the second matrix
+    // - mapMode: MAP_OUTER sends columns of matrix1 in place of its rows
+
+    // A mapper's rows are adjacent in the matrix, so each block leaves as a single message
+    // described by a strided datatype, with no staging copy.
+
+    int *headers = (int *)malloc(2 * Mappers * sizeof(int));
+    MPI_Request *requests = (MPI_Request *)malloc(3 * Mappers * sizeof(MPI_Request));
 
-    // Initialize a variable k with a value of 0
-    int k = 0;
     for (int i = 1; i < Mappers + 1; i++)
     {
         // Iterate over the range [1, Mappers + 1) with the variable i
         // i represents the current mapper's index
 
-        for (int j = 0; j < chunkSize; j++, k++)
-        {
-            // Iterate over the range [0, chunkSize) with the variable j
-            // j represents the current row index within the assigned chunk
+        int k = blockStart(i - 1, Mappers, size);
+        int rows = blockLength(i - 1, Mappers, size);
+        int *header = &headers[2 * (i - 1)];
+        header[0] = k;
+        header[1] = rows;
+        // First row of the block and the number of rows in it, the first size % Mappers mappers get one extra
 
-            // Send the value of k (current row index) to the mapper with rank i
-            MPI_Send(&k, 1, MPI_INT, i, 1, MPI_COMM_WORLD);
+        MPI_Datatype blockA = mapMode == MAP_OUTER ? createMatrixBlockType(matrix1, size, rows) : createMatrixBlockType(matrix1, rows, size);
+        MPI_Datatype blockB = createMatrixBlockType(matrix2, rows, size);
+        // Outer product mode takes a size x rows block of columns of matrix1
 
-            // Send the contents of the kth row of matrix1 to the mapper with rank i
-            MPI_Send(matrix1[k], size, MPI_INT, i, 2, MPI_COMM_WORLD);
+        MPI_Isend(header, 2, MPI_INT, i, 1, MPI_COMM_WORLD, &requests[3 * (i - 1)]);
 
-            // Send the contents of the kth row of matrix2 to the mapper with rank i
-            MPI_Send(matrix2[k], size, MPI_INT, i, 3, MPI_COMM_WORLD);
-        }
+        const int *firstA = mapMode == MAP_OUTER ? &MATRIX_AT(matrix1, 0, k) : MATRIX_ROW(matrix1, k);
+        MPI_Isend(firstA, 1, blockA, i, 2, MPI_COMM_WORLD, &requests[3 * (i - 1) + 1]);
+        // Rows k .. k + rows of matrix1, or its columns in outer product mode
+
+        MPI_Isend(MATRIX_ROW(matrix2, k), 1, blockB, i, 3, MPI_COMM_WORLD, &requests[3 * (i - 1) + 2]);
+        // Rows k .. k + rows of matrix2
+
+        MPI_Type_free(&blockA);
+        MPI_Type_free(&blockB);
+        // Freeing only marks the types, the pending sends keep them alive
 
         // Print a message indicating the task map assigned to process i
         printf("Task Map Assigned to process %d.\n", i);
     }
 
+    MPI_Waitall(3 * Mappers, requests, MPI_STATUSES_IGNORE);
+    // The blocks travel to all mappers at once
+
+    free(headers);
+    free(requests);
 }
 
 
-void freeMasterResources(int **matrix1, int **matrix2, char *machineName, int Size)
+void freeMasterResources(Matrix *matrix1, Matrix *matrix2, char *machineName)
 {
-    freeMatrix(matrix1, Size);
-    freeMatrix(matrix2, Size);
+    freeMatrix(matrix1);
+    freeMatrix(matrix2);
     free(machineName);
 }
 
@@ -246,80 +669,136 @@ void printReceivedTask(int rank, const char *machineName)
 }
 
 
-void receiveData(int rank, int size, int *row, int **matrix1, int **matrix2)
+void receiveRowBlock(int size, MapMode mapMode, MapperInput *input)
 {
-    // Function to receive data from the master process
+    // Function to receive a mapper's block of rows from the master process
     // Inputs:
-    // - rank: current process rank
     // - size: size of the matrix
-    // - row: pointer to store the received row index
-    // - matrix1: pointer to store the received matrix1 row
-    // - matrix2: pointer to store the received matrix2 row
+    // - mapMode: MAP_OUTER receives a size x count block of columns of the first matrix
+    // - input: receives the first row index, the row count and the blocks of both matrices
 
-    MPI_Status status;
-    // Create an MPI_Status object to store status information about the received message
-
-    MPI_Recv(row, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &status);
-    // Receive a single integer (row index) from the master process (rank 0)
-    // The received data is stored in the 'row' variable
-    // The tag 1 is used to identify the message type
-    // MPI_COMM_WORLD is the communicator representing all processes
-    // The 'status' object will store information about the received message
-
-    *matrix1 = (int *)malloc(size * sizeof(int));
-    // Allocate memory for matrix1 row
-    // The size of the row is 'size' multiplied by the size of an integer
-
-    *matrix2 = (int *)malloc(size * sizeof(int));
-    // Allocate memory for matrix2 row
-    // The size of the row is 'size' multiplied by the size of an integer
-
-    MPI_Recv(*matrix1, size, MPI_INT, 0, 2, MPI_COMM_WORLD, &status);
-    // Receive 'size' number of integers (matrix1 row) from the master process (rank 0)
-    // The received data is stored in the memory pointed to by 'matrix1'
-    // The tag 2 is used to identify the message type
-    // MPI_COMM_WORLD is the communicator representing all processes
-    // The 'status' object will store information about the received message
-
-    MPI_Recv(*matrix2, size, MPI_INT, 0, 3, MPI_COMM_WORLD, &status);
-    // Receive 'size' number of integers (matrix2 row) from the master process (rank 0)
-    // The received data is stored in the memory pointed to by 'matrix2'
-    // The tag 3 is used to identify the message type
-    // MPI_COMM_WORLD is the communicator representing all processes
-    // The 'status' object will store information about the received message
+    int header[2];
+    MPI_Recv(header, 2, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // The tag 1 message carries the first row index and the row count
+    input->firstRow = header[0];
+    input->rows = header[1];
+
+    input->blockA = mapMode == MAP_OUTER ? allocateMatrix(size, input->rows) : allocateMatrix(input->rows, size);
+    input->blockB = allocateMatrix(input->rows, size);
+
+    MPI_Datatype typeA = createMatrixBlockType(input->blockA, input->blockA->rows, input->blockA->cols);
+    MPI_Datatype typeB = createMatrixBlockType(input->blockB, input->blockB->rows, input->blockB->cols);
+
+    MPI_Recv(input->blockA->data, 1, typeA, 0, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // The block of matrix1 is identified by tag 2
+    MPI_Recv(input->blockB->data, 1, typeB, 0, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // The block of matrix2 is identified by tag 3
+
+    MPI_Type_free(&typeA);
+    MPI_Type_free(&typeB);
+}
+
+void readRowBlocksCollective(int rank, int Mappers, int size, char *inputFile1, char *inputFile2, MapMode mapMode, MapperInput *input)
+{
+    // Function to have every mapper read its own block of rows from the input files, called by all ranks
+    // Inputs:
+    // - rank: current process rank, mappers are ranks 1 .. Mappers
+    // - Mappers: total number of mappers, the rows are split between them with blockStart / blockLength
+    // - size: size of the matrix
+    // - inputFile1, inputFile2: the input files, visible to every rank
+    // - mapMode: MAP_OUTER reads the matching size x rows block of columns of the first matrix
+    // - input: receives the mapper's blocks, left empty on other ranks
+
+    int isMapper = rank >= 1 && rank <= Mappers;
+    input->firstRow = isMapper ? blockStart(rank - 1, Mappers, size) : 0;
+    input->rows = isMapper ? blockLength(rank - 1, Mappers, size) : 0;
+
+    if (mapMode == MAP_OUTER)
+    {
+        input->blockA = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile1, size, 0, isMapper ? size : 0, input->firstRow, input->rows);
+    }
+    else
+    {
+        input->blockA = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile1, size, input->firstRow, input->rows, 0, size);
+    }
+    input->blockB = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile2, size, input->firstRow, input->rows, 0, size);
+}
+
+void freeMapperInput(MapperInput *input)
+{
+    awaitRows(input, input->rows);
+    // Gets still in flight write into the blocks, let them finish first
+
+    freeMatrix(input->blockA);
+    freeMatrix(input->blockB);
+    input->blockA = NULL;
+    input->blockB = NULL;
+    input->rows = 0;
 }
 
 //-----------------------------Mapper---------------------------------//
 
-void sendMapperData(const MatrixKey *key, const MatrixValue *value)
+void sendMapperData(const MatrixKey *keys, const MatrixValue *values, int count)
 {
-    // Function to send mapper data to the master process
+    // Function to send a batch of mapper data to the master process
     // Inputs:
-    // - key: pointer to the MatrixKey struct containing mapper data
-    // - value: pointer to the MatrixValue struct containing mapper data
+    // - keys: contiguous array of 'count' MatrixKey structs
+    // - values: contiguous array of 'count' MatrixValue structs, values[i] belongs to keys[i]
+    // - count: number of key-value pairs in the batch
 
-    MPI_Send(key, sizeof(MatrixKey), MPI_BYTE, 0, 10, MPI_COMM_WORLD);
-    // Send the data pointed to by 'key' to the master process (rank 0)
-    // The size of the data is determined by sizeof(MatrixKey)
-    // MPI_BYTE is the datatype of the data being sent
+    Phase previous = enterPhase(PHASE_SHUFFLE);
+    MPI_Send(keys, count * sizeof(MatrixKey), MPI_BYTE, 0, 10, MPI_COMM_WORLD);
+    // Send all keys of the batch to the master process (rank 0) in one message
     // The tag 10 is used to identify the message type
-    // MPI_COMM_WORLD is the communicator representing all processes
 
-    MPI_Send(value, sizeof(MatrixValue), MPI_BYTE, 0, 20, MPI_COMM_WORLD);
-    // Send the data pointed to by 'value' to the master process (rank 0)
-    // The size of the data is determined by sizeof(MatrixValue)
-    // MPI_BYTE is the datatype of the data being sent
+    MPI_Send(values, count * sizeof(MatrixValue), MPI_BYTE, 0, 20, MPI_COMM_WORLD);
+    // Send the matching values in a second message
     // The tag 20 is used to identify the message type
-    // MPI_COMM_WORLD is the communicator representing all processes
+    enterPhase(previous);
 }
 
-//--------------------------------------------------------------------//
+void initPairBatch(PairBatch *batch, int capacity)
+{
+    batch->keys = (MatrixKey *)malloc(capacity * sizeof(MatrixKey));
+    batch->values = (MatrixValue *)malloc(capacity * sizeof(MatrixValue));
+    batch->count = 0;
+    batch->capacity = capacity;
+}
+
+// Appends a pair to the batch and ships the batch once it is full
+
+void emitPair(PairBatch *batch, const MatrixKey *key, const MatrixValue *value)
+{
+    batch->keys[batch->count] = *key;
+    batch->values[batch->count] = *value;
+    batch->count++;
+
+    if (batch->count == batch->capacity)
+    {
+        flushPairBatch(batch);
+    }
+}
+
+void flushPairBatch(PairBatch *batch)
+{
+    if (batch->count > 0)
+    {
+        sendMapperData(batch->keys, batch->values, batch->count);
+        batch->count = 0;
+    }
+}
 
-void freeData(int *matrix1, int *matrix2)
+void freePairBatch(PairBatch *batch)
 {
-    free(matrix1);
-    free(matrix2);
+    free(batch->keys);
+    free(batch->values);
+    batch->keys = NULL;
+    batch->values = NULL;
+    batch->capacity = 0;
 }
+
+//--------------------------------------------------------------------//
+
 void printCompletedTask(int rank, const char *machineName)
 {
     printf("Process %d has completed task map on %s.\n", rank, machineName);
@@ -327,91 +806,239 @@ void printCompletedTask(int rank, const char *machineName)
 
 ///----------------------------------------------------------------------   //
 
-
-void processTaskMap(int rank, int dropout, int chunkSize, int size)
+void mapRowToPairs(int row, int size, const int *matrixA, const int *matrixB, int sparse, PairEmitter emit, void *context)
 {
-    // Function to process the mapping task for a specific rank
+    // Function to turn one row of each input matrix into key-value pairs
     // Inputs:
-    // - rank: rank of the current process
-    // - dropout: number of processes to be ignored in mapping task
-    // - chunkSize: number of rows to process
+    // - row: index of the received row
     // - size: size of the matrices
+    // - matrixA: row 'row' of the first matrix
+    // - matrixB: row 'row' of the second matrix
+    // - sparse: skip zero elements, they add nothing to any output cell
+    // - emit: called once for every produced key-value pair
+    // - context: passed through to 'emit'
 
-    if (rank != 0 && rank < dropout)
+    for (int j = 0; j < size; j++)
     {
-        // Check if the current process rank is not 0 and less than the dropout value
-
-        char *machineName = malloc(MPI_MAX_PROCESSOR_NAME * sizeof(char));
-        // Allocate memory to store the machine name where the process is running
-        int nameLength;
-        MPI_Get_processor_name(machineName, &nameLength);
-        // Get the name of the machine where the process is running and store it in machineName
-        printReceivedTask(rank, machineName);
-        // Print a message indicating that the task has been received by the process
-        MPI_Status status;
+        // Loop over the elements of matrix A, A[row][j] is needed by every cell (row, k)
 
-        for (int ind = 0; ind < chunkSize; ind++)
+        if (sparse && matrixA[j] == 0)
         {
-            // Loop over the chunkSize, which represents the number of rows to process
+            continue;
+        }
 
-            int row = 0;
-            int *matrixA = NULL;
-            int *matrixB = NULL;
-            // Declare variables to store the row number, matrix A, and matrix B
+        for (int k = 0; k < size; k++)
+        {
+            MatrixKey key;
+            MatrixValue value;
+            // Declare variables to store the key and value for mapping
+
+            key.k = k;
+            key.i = row;
+            // Set the key values based on the current indices
+            value.mat = '1';
+            value.j = j;
+            value.val = matrixA[j];
+            // Set the value attributes based on the current indices and matrixA
+
+            emit(context, &key, &value);
+            // Hand the key-value pair to the caller
+        }
+    }
 
-            receiveData(rank, size, &row, &matrixA, &matrixB);
-            // Receive data from the master process (rank 0) into row, matrixA, and matrixB
+    for (int k = 0; k < size; k++)
+    {
+        // Loop over the elements of matrix B, B[row][k] is needed by every cell (i, k)
 
-            int j, k;
-            for (j = 0, k = 0; j < size * size; j++, k = (j / size))
-            {
-                // Loop over the elements of matrix A
-
-                MatrixKey key;
-                MatrixValue value;
-                // Declare variables to store the key and value for mapping
-
-                key.k = j % size;
-                key.i = row;
-                // Set the key values based on the current indices
-                value.mat = '1';
-                value.j = k;
-                value.val = matrixA[k];
-                // Set the value attributes based on the current indices and matrixA
-
-                sendMapperData(&key, &value);
-                // Send the key-value pair to the master process
-            }
+        if (sparse && matrixB[k] == 0)
+        {
+            continue;
+        }
 
-            int i = 0;
-            while (i < size * size)
-            {
-                // Loop over the elements of matrix B
+        for (int i = 0; i < size; i++)
+        {
+            MatrixKey key;
+            MatrixValue value;
+            // Declare variables to store the key and value for mapping
+
+            key.i = i;
+            key.k = k;
+            // Set the key values based on the current indices
+            value.mat = '2';
+            value.j = row;
+            value.val = matrixB[k];
+            // Set the value attributes based on the current indices and matrixB
+
+            emit(context, &key, &value);
+            // Hand the key-value pair to the caller
+        }
+    }
+}
 
-                int k = i / size;
-                int j = i % size;
-                // Calculate the indices based on the current iteration
+// Adds the outer products of the mapper's columns of A with the matching rows of B to its
+// partial result. Side by side the columns form a size x count block, so this is one
+// size x count times count x size block product.
 
-                MatrixKey key;
-                MatrixValue value;
-                // Declare variables to store the key and value for mapping
+void combineOuterProducts(const Matrix *columnsA, const Matrix *rowsB, Matrix *partial)
+{
+    gemmAccumulate(partial->rows, partial->cols, columnsA->cols, columnsA->data, columnsA->stride,
+                   rowsB->data, rowsB->stride, partial->data, partial->stride);
+}
 
-                key.i = j;
-                key.k = k;
-                // Set the key values based on the current indices
-                value.mat = '2';
-                value.j = row;
-                value.val = matrixB[k];
-                // Set the value attributes based on the current indices and matrixB
+void emitPartialSums(int size, int mapper, const Matrix *partial, int sparse, PairEmitter emit, void *context)
+{
+    // Function to emit one partial sum per output cell once a mapper has combined all its columns
+    // Inputs:
+    // - size: size of the matrices
+    // - mapper: rank of the mapper, stored in the value so every partial sum stays distinct
+    // - partial: size x size combined partial result
+    // - sparse: skip partial sums that are zero
+    // - emit, context: receive the key-value pairs
+
+    for (int cell = 0; cell < size * size; cell++)
+    {
+        MatrixKey key;
+        MatrixValue value;
+        key.i = cell / size;
+        key.k = cell % size;
+        value.mat = 'P';
+        value.j = mapper;
+        value.val = MATRIX_AT(partial, key.i, key.k);
+        if (!sparse || value.val != 0)
+        {
+            emit(context, &key, &value);
+        }
+    }
+}
+
+// Returns how many key-value pairs a mapper produces for its block of 'rows' rows
+
+long long pairsPerMapper(int rows, int size, MapMode mapMode)
+{
+    if (mapMode == MAP_OUTER)
+    {
+        return (long long)size * size;
+    }
+    return (long long)rows * size * size * 2;
+}
+
+static void emitToSlice(void *context, const MatrixKey *key, const MatrixValue *value)
+{
+    appendPair((PairBatch *)context, key, value);
+}
+
+void mapRowGroup(int size, int firstRow, int start, int count, const Matrix *blockA, const Matrix *blockB, int sparse, PairBatch *slices)
+{
+    // Function to map a group of rows on the rank's threads
+    // Inputs:
+    // - size: size of the matrices
+    // - firstRow: matrix row held in row 0 of the blocks
+    // - start, count: the group is rows start .. start + count of the blocks
+    // - blockA, blockB: the mapper's rows of A and B
+    // - sparse: emit nonzero elements only
+    // - slices: one per row, each with room for 2 * size * size pairs, filled independently
+
+    #pragma omp parallel for schedule(static)
+    for (int g = 0; g < count; g++)
+    {
+        slices[g].count = 0;
+        mapRowToPairs(firstRow + start + g, size, MATRIX_ROW(blockA, start + g), MATRIX_ROW(blockB, start + g), sparse, emitToSlice, &slices[g]);
+    }
+}
 
-                sendMapperData(&key, &value);
-                // Send the key-value pair to the master process
+static void emitToBatch(void *context, const MatrixKey *key, const MatrixValue *value)
+{
+    emitPair((PairBatch *)context, key, value);
+}
 
-                i++;
+void processTaskMap(int rank, int size, const JobOptions *options, MapperInput *input)
+{
+    // Function to process the mapping task for a specific rank
+    // Inputs:
+    // - rank: rank of the current process
+    // - size: size of the matrices
+    // - options: job options, the batch size decides how many pairs go out per message
+    // - input: the mapper's rows, read collectively or received from the master
+
+    if (rank != 0)
+    {
+        // Check if the current process rank is not 0, every other rank maps
+
+        char *machineName = malloc(MPI_MAX_PROCESSOR_NAME * sizeof(char));
+        // Allocate memory to store the machine name where the process is running
+        int nameLength;
+        MPI_Get_processor_name(machineName, &nameLength);
+        // Get the name of the machine where the process is running and store it in machineName
+        printReceivedTask(rank, machineName);
+        // Print a message indicating that the task has been received by the process
+
+        PairBatch batch;
+        initPairBatch(&batch, resolveBatchSize(options, size));
+        // Key-value pairs are collected here and sent to the master a full batch at a time
+
+        Matrix *blockA = input->blockA;
+        Matrix *blockB = input->blockB;
+        int rows = input->rows;
+
+        if (options->mapMode == MAP_OUTER)
+        {
+            awaitRows(input, rows);
+            Matrix *partial = allocateMatrix(size, size);
+            combineOuterProducts(blockA, blockB, partial);
+            // blockA holds columns of A here, add their outer products with the rows of B
+
+            emitPartialSums(size, rank, partial, options->sparse, emitToBatch, &batch);
+            freeMatrix(partial);
+            // Only one partial sum per output cell leaves the mapper
+        }
+        else
+        {
+            int group = rankThreadCount();
+            PairBatch *slices = (PairBatch *)malloc(group * sizeof(PairBatch));
+            for (int g = 0; g < group; g++)
+            {
+                initPairBatch(&slices[g], size * size * 2);
             }
 
-            freeData(matrixA, matrixB);
-            // Free the memory allocated for matrixA and matrixB
+            for (int ind = 0; ind < rows; ind += group)
+            {
+                // The rows are mapped a group at a time on all threads of the rank
+
+                int count = rows - ind < group ? rows - ind : group;
+
+                awaitRows(input, ind + count);
+                mapRowGroup(size, input->firstRow, ind, count, blockA, blockB, options->sparse, slices);
+                for (int g = 0; g < count; g++)
+                {
+                    for (int p = 0; p < slices[g].count; p++)
+                    {
+                        emitPair(&batch, &slices[g].keys[p], &slices[g].values[p]);
+                    }
+                }
+                // Add the key-value pairs of the rows to the outgoing batch, in row order
+            }
+
+            for (int g = 0; g < group; g++)
+            {
+                freePairBatch(&slices[g]);
+            }
+            free(slices);
+        }
+
+        if (options->verify == VERIFY_EXACT)
+        {
+            freeMapperInput(input);
+        }
+        // Free the memory allocated for the rows, unless the Freivalds check still needs them
+
+        flushPairBatch(&batch);
+        freePairBatch(&batch);
+        // Send whatever is left in the last partial batch
+
+        if (options->sparse)
+        {
+            sendMapperData(NULL, NULL, 0);
+            // The master cannot work out how many nonzero pairs to expect, an empty batch ends the mapper's output
         }
 
         printCompletedTask(rank, machineName);
@@ -423,52 +1050,54 @@ void processTaskMap(int rank, int dropout, int chunkSize, int size)
 
 //--------------------------------------------------------------------//
 
-void receiveMapperData(int source, MatrixKey *key, MatrixValue *value)
+int receiveMapperData(int source, MatrixKey *keys, MatrixValue *values)
 {
-    // Function to receive data from a specific source process
+    // Function to receive one batch of mapper data from a specific source process
     // Inputs:
     // - source: rank of the source process
-    // - key: pointer to MatrixKey struct to store the received key
-    // - value: pointer to MatrixValue struct to store the received value
-
-    MPI_Recv(key, sizeof(MatrixKey), MPI_BYTE, source, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    // Receive the MatrixKey struct from the source process
-    // - key: pointer to the memory location where the received key will be stored
-    // - sizeof(MatrixKey): size of the MatrixKey struct in bytes
-    // - MPI_BYTE: data type of the received message
-    // - source: rank of the source process
-    // - 10: message tag associated with the received message
-    // - MPI_COMM_WORLD: communicator that identifies the group of processes
-    // - MPI_STATUS_IGNORE: ignore the status information of the received message
-
-    MPI_Recv(value, sizeof(MatrixValue), MPI_BYTE, source, 20, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    // Receive the MatrixValue struct from the source process
-    // - value: pointer to the memory location where the received value will be stored
-    // - sizeof(MatrixValue): size of the MatrixValue struct in bytes
-    // - MPI_BYTE: data type of the received message
-    // - source: rank of the source process
-    // - 20: message tag associated with the received message
-    // - MPI_COMM_WORLD: communicator that identifies the group of processes
-    // - MPI_STATUS_IGNORE: ignore the status information of the received message
+    // - keys: pointer to the first free MatrixKey slot, the batch is written here
+    // - values: pointer to the first free MatrixValue slot, the batch is written here
+    // Returns the number of key-value pairs received
+
+    MPI_Status status;
+    int bytes = 0;
+
+    MPI_Probe(source, 10, MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, MPI_BYTE, &bytes);
+    // Peek at the next key batch from the source to learn how many pairs it carries
+
+    int count = bytes / sizeof(MatrixKey);
+
+    MPI_Recv(keys, count * sizeof(MatrixKey), MPI_BYTE, source, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Receive the keys of the batch (tag 10)
+
+    MPI_Recv(values, count * sizeof(MatrixValue), MPI_BYTE, source, 20, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Receive the matching values of the batch (tag 20)
+
+    return count;
 }
 
 
 //--------------------------------------------------------------------//
 
-void assignReduceTask(int rank, int *reducerRanks, int reducerChunkSize, int size, MatrixKey *keys, MatrixValue *values)
+void assignReduceTask(int *reducerRanks, int Reducers, int size, IntermediateStore *store)
 {
     // Function to assign reduce tasks to specific processes
     // Inputs:
-    // - rank: rank of the current process
     // - reducerRanks: array of reducer process ranks
-    // - reducerChunkSize: number of reduce tasks assigned to each reducer process
+    // - Reducers: number of reducer processes, each owns the run of keys given by reducerKeyRange
     // - size: size of the matrices (size x size)
-    // - keys: array of MatrixKey structs
-    // - values: array of MatrixValue structs
+    // - store: every pair received from the mappers
+
+    storeFinish(store);
+    // Bucket all received values by output cell in one pass instead of scanning them once per cell
+
+    printf("Grouping time: %f seconds\n", store->groupingTime);
 
     int t = 0;
-    int counter = 0;
-    // Initialize variables to track reducer ranks and task counter
+    int firstKey, numKeys;
+    reducerKeyRange(t, Reducers, size, &firstKey, &numKeys);
+    // Start with the first reducer and its run of keys
 
     for (int i = 0; i < size * size; i++)
     {
@@ -481,14 +1110,13 @@ void assignReduceTask(int rank, int *reducerRanks, int reducerChunkSize, int siz
         key.k = col;
         // Create a MatrixKey struct with the current row and column indices
 
-        if (counter == reducerChunkSize)
+        if (i == firstKey + numKeys)
         {
             printf("Task Reduce Assigned to process %d.\n", reducerRanks[t]);
             // Print a message indicating the assignment of a reduce task to a specific process
             t++;
-            // Move to the next reducer process
-            counter = 0;
-            // Reset the task counter
+            reducerKeyRange(t, Reducers, size, &firstKey, &numKeys);
+            // Move to the next reducer process and its run, runs differ in length by at most one key
         }
 
         MPI_Send(&key, sizeof(MatrixKey), MPI_BYTE, reducerRanks[t], 10, MPI_COMM_WORLD);
@@ -500,20 +1128,13 @@ void assignReduceTask(int rank, int *reducerRanks, int reducerChunkSize, int siz
         // - 10: message tag associated with the message
         // - MPI_COMM_WORLD: communicator that identifies the group of processes
 
-        for (int k = 0; k < size * size * size * 2; k++)
-        {
-            MatrixValue value = values[k];
-            // Get the current MatrixValue from the values array
-
-            if (keys[k].i == row && keys[k].k == col)
-            {
-                MPI_Send(&value, sizeof(MatrixValue), MPI_BYTE, reducerRanks[t], 20, MPI_COMM_WORLD);
-                // Send the MatrixValue to the current reducer process if the key matches
-            }
-        }
+        int keyIndex, count;
+        MatrixValue *bucket;
+        storeNextKey(store, &keyIndex, &bucket, &count);
+        // Keys come out of the store in the same row-major order they are assigned in
 
-        counter++;
-        // Increment the task counter
+        MPI_Send(bucket, count * sizeof(MatrixValue), MPI_BYTE, reducerRanks[t], 20, MPI_COMM_WORLD);
+        // Send the whole bucket of the key to the current reducer process in one message
     }
 
     printf("Task Reduce Assigned to process %d.\n", reducerRanks[t]);
@@ -523,7 +1144,7 @@ void assignReduceTask(int rank, int *reducerRanks, int reducerChunkSize, int siz
 //--------------------------------------------------------------------//
 
 
-int *initializeReducerRanks(int Reducers, int totalproc)
+int *initializeReducerRanks(int Reducers)
 {
     int *reducerRanks = (int *)malloc(Reducers * sizeof(int));
     for (int i = 0; i < Reducers; i++)
@@ -535,175 +1156,724 @@ int *initializeReducerRanks(int Reducers, int totalproc)
 
 //--------------------------------------------------------------------//
 
-void validateMapperConfiguration(int Size, int Mappers, int totalproc, int *dropout)
+void writeResultToFile(int Rank, int Size, Matrix *outputarr, const JobOptions *options, const ReducerOutput *output)
 {
-    if (Size * Size * 2 * Mappers > totalproc - 1)
-    {
-        printf("Error: Number of processes is not sufficient to perform the task.\n");
-        printf("Number of processes required: %d\n", Size * Size * 2 * Mappers + 1);
-        printf("Number of processes available: %d\n", totalproc);
-        *dropout = 1;
-    }
-}
-
-//--------------------------------------------------------------------//
-
-void writeResultToFile(int Rank, int Size, int **outputarr, char *File1, char *File2)
-{
-    // Function to write the result of matrix multiplication to a file
+    // Function to collect the reducers' cells on the master and write the result to a file, called by all ranks
     // Inputs:
     // - Rank: rank of the current process
     // - Size: size of the matrices (Size x Size)
-    // - outputarr: 2D array containing the result matrix
-    // - File1: name of the first input file
-    // - File2: name of the second input file
+    // - outputarr: Size x Size matrix receiving the result, only used on the master
+    // - options: job options, the output format decides how the result is written
+    // - output: the reducer's cells, empty on ranks that did not reduce
+
+    // Every reducer owns one contiguous run of keys, so its cells go out as a single block
+    // and their row and column follow from the position in the result.
+
+    int numOfProcesses;
+    MPI_Comm_size(MPI_COMM_WORLD, &numOfProcesses);
+
+    int range[2] = {output->firstKey, output->numKeys};
+    int *ranges = NULL;
+    int *counts = NULL;
+    int *displs = NULL;
+    int *cells = NULL;
 
     if (Rank == 0)
     {
-        // Execute the following code only for the root process (Rank 0)
+        ranges = (int *)malloc(2 * numOfProcesses * sizeof(int));
+        counts = (int *)malloc(numOfProcesses * sizeof(int));
+        displs = (int *)malloc(numOfProcesses * sizeof(int));
+        cells = (int *)malloc(((size_t)Size * Size + 1) * sizeof(int));
+    }
+
+    MPI_Gather(range, 2, MPI_INT, ranges, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    // First key and key count of every rank, zero for ranks that did not reduce
+
+    for (int p = 0; Rank == 0 && p < numOfProcesses; p++)
+    {
+        displs[p] = ranges[2 * p];
+        counts[p] = ranges[2 * p + 1];
+    }
 
-        FILE *outp;
-        outp = fopen("Output.txt", "w");
-        // Open the "Output.txt" file in write mode
+    MPI_Gatherv(output->values, output->numKeys, MPI_INT, cells, counts, displs, MPI_INT, 0, MPI_COMM_WORLD);
+    // Each reducer's block lands at its first key in the row-major result
+    enterPhase(PHASE_NONE);
 
-        if (outp == NULL)
+    if (Rank == 0)
+    {
+        for (int row = 0; row < Size; row++)
         {
-            printf("Error!");
-            exit(1);
+            memcpy(MATRIX_ROW(outputarr, row), &cells[(size_t)row * Size], Size * sizeof(int));
         }
-        // Check if the file was opened successfully, and if not, print an error message and exit the program
+        // One copy into the aligned, padded rows of the result
+
+        free(ranges);
+        free(counts);
+        free(displs);
+        free(cells);
+
+        printf("\nJob has been Completed");
+
+        writeOutputMatrix(outputarr, options);
+        // Write the result matrix to Output.txt, or Output.bin in the binary format
+    }
+}
+
+void writeMatrixToFile(char *filename, const Matrix *matrix)
+{
+    FILE *outp;
+    outp = fopen(filename, "w");
+    // Open the output file in write mode
 
-        for (int i = 0; i < Size * Size; i++)
+    if (outp == NULL)
+    {
+        printf("Error!");
+        exit(1);
+    }
+    // Check if the file was opened successfully, and if not, print an error message and exit the program
+
+    for (int i = 0; i < matrix->rows; i++)
+    {
+        for (int j = 0; j < matrix->cols; j++)
         {
-            ReducerKeyValue KeyValue;
-            MPI_Recv(&KeyValue, sizeof(ReducerKeyValue), MPI_BYTE, MPI_ANY_SOURCE, 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            // Receive a ReducerKeyValue struct from any source process
-            // - &KeyValue: pointer to the ReducerKeyValue struct
-            // - sizeof(ReducerKeyValue): size of the ReducerKeyValue struct in bytes
-            // - MPI_BYTE: data type of the message
-            // - MPI_ANY_SOURCE: accept messages from any source process
-            // - 5: message tag associated with the message
-            // - MPI_COMM_WORLD: communicator that identifies the group of processes
+            fprintf(outp, "%d ", MATRIX_AT(matrix, i, j));
+            // Write each element of the matrix to the file
+        }
+        fprintf(outp, "\n");
+        // Write a new line character to separate rows in the file
+    }
+
+    fclose(outp);
+    // Close the file
+}
+
+// Name of the file the result matrix goes to in the chosen output format
+
+char *outputFileName(const JobOptions *options)
+{
+    if (options->outputFormat == FORMAT_COORDINATE)
+    {
+        return "Output.mtx";
+    }
+    return options->outputFormat == FORMAT_BINARY ? "Output.bin" : "Output.txt";
+}
 
-            outputarr[KeyValue.row][KeyValue.col] = KeyValue.value;
-            // Store the received value in the appropriate position of the outputarr matrix
+void writeOutputMatrix(const Matrix *matrix, const JobOptions *options)
+{
+    Phase previous = enterPhase(PHASE_WRITE);
+    if (options->outputFormat == FORMAT_BINARY)
+    {
+        if (writeBinaryMatrix(outputFileName(options), matrix) != 0)
+        {
+            exit(1);
         }
+    }
+    else if (options->outputFormat == FORMAT_COORDINATE)
+    {
+        if (writeCoordinateMatrix(outputFileName(options), matrix) != 0)
+        {
+            exit(1);
+        }
+    }
+    else
+    {
+        writeMatrixToFile(outputFileName(options), matrix);
+    }
+    enterPhase(previous);
+}
 
-        printf("\nJob has been Completed");
+void printMatrixComparison(char *File1, char *File2, char *OutputFile, int size)
+{
+    Phase previous = enterPhase(PHASE_VERIFY);
+    printf("\nMatrix Comparison Function Returned: ");
+    if (compareMatrices(File1, File2, OutputFile, size))
+    {
+        printf("True\n");
+    }
+    else
+    {
+        printf("False");
+    }
+    // Call the compareMatrices function to compare the generated output with the expected result
+    enterPhase(previous);
+}
 
-        for (int i = 0; i < Size; i++)
+
+//--------------------------------------------------------------------//
+
+static int compareValuesByIndex(const void *a, const void *b)
+{
+    const MatrixValue *x = (const MatrixValue *)a;
+    const MatrixValue *y = (const MatrixValue *)b;
+    if (x->j != y->j)
+    {
+        return x->j < y->j ? -1 : 1;
+    }
+    return x->mat - y->mat;
+}
+
+static int joinSparseValues(const MatrixValue *values, int count, int size, MatrixValue *sorted, int *result)
+{
+    // Function to reduce a key whose values only cover some inner indices
+    // Sorted by inner index, an element of A and one of B with the same index sit side by side;
+    // an index with only one of them has a zero on the other side and adds nothing
+    // 'sorted' has room for 2 * size values, count is at most that
+    // Returns -1 if an inner index is out of range or appears twice for the same matrix
+
+    memcpy(sorted, values, count * sizeof(MatrixValue));
+    qsort(sorted, count, sizeof(MatrixValue), compareValuesByIndex);
+
+    int status = 0;
+    unsigned int val = 0;
+    for (int n = 0; n < count && status == 0;)
+    {
+        int end = n + 1;
+        while (end < count && sorted[end].j == sorted[n].j)
+        {
+            end++;
+        }
+        // Values n .. end share an inner index, at most one of them from each matrix
+
+        for (int m = n; m < end; m++)
         {
-            for (int j = 0; j < Size; j++)
+            if (sorted[m].mat != '1' && sorted[m].mat != '2')
             {
-                fprintf(outp, "%d ", outputarr[i][j]);
-                // Write each element of the outputarr matrix to the file
+                status = -1;
             }
-            fprintf(outp, "\n");
-            // Write a new line character to separate rows in the file
         }
+        if (sorted[n].j < 0 || sorted[n].j >= size || end - n > 2 || (end - n == 2 && sorted[n].mat == sorted[n + 1].mat))
+        {
+            status = -1;
+        }
+        else if (end - n == 2)
+        {
+            val += (unsigned int)sorted[n].val * (unsigned int)sorted[n + 1].val;
+        }
+        n = end;
+    }
 
-        fclose(outp);
-        // Close the file
+    *result = (int)val;
+    return status;
+}
 
-        printf("\nMatrix Comparison Function Returned: ");
-        if (compareMatrices(File1, File2, "Output.txt", Size))
+int reduceKeyValues(const MatrixValue *values, int count, int size, int sparse, void *scratch, int *result)
+{
+    // Function to compute one output cell from all values of its key
+    // Inputs:
+    // - values: the values received for the key, one from each matrix per inner index, or
+    //   fewer when the mappers left out zero elements
+    // - count: number of values
+    // - size: size of the matrices (Size x Size)
+    // - sparse: missing values are zeros left out by the mappers rather than lost ones
+    // - scratch: REDUCE_SCRATCH_BYTES(size) bytes of working memory, one buffer per thread
+    // - result: receives the output cell
+    // Returns 0 on success, -1 if a value is missing or an inner index appears twice
+
+    if (count > 0 && values[0].mat == 'P')
+    {
+        unsigned int val = 0;
+        for (int n = 0; n < count; n++)
         {
-            printf("True\n");
+            val += (unsigned int)values[n].val;
         }
-        else
+        *result = (int)val;
+        return 0;
+        // Outer product mode: the mappers already multiplied, only their partial sums are added
+    }
+
+    *result = 0;
+    if (count > 2 * size)
+    {
+        return -1;
+        // More values than inner indices of both matrices, at least one of them is a duplicate
+    }
+
+    if (sparse)
+    {
+        return joinSparseValues(values, count, size, (MatrixValue *)scratch, result);
+        // Only the values that are there are joined, at a cost that follows their number
+    }
+
+    if (count != 2 * size)
+    {
+        return -1;
+        // Every inner index needs one value from each matrix
+    }
+
+    int *row = (int *)scratch;
+    int *column = row + size;
+    unsigned char *seen = (unsigned char *)(column + size);
+    memset(seen, 0, 2 * (size_t)size);
+
+    int status = 0;
+    for (int n = 0; n < count; n++)
+    {
+        int j = values[n].j;
+        int side = values[n].mat == '2';
+        if (j < 0 || j >= size || (values[n].mat != '1' && !side) || seen[side * size + j])
         {
-            printf("False");
+            status = -1;
+            break;
         }
-        // Call the compareMatrices function to compare the generated output with the expected result
+        seen[side * size + j] = 1;
+        (side ? column : row)[j] = values[n].val;
     }
-}
+    // Scatter by inner index: A[i][j] to row[j], B[j][k] to column[j]. With 2 * size values and
+    // no index taken twice, every index of both vectors is filled
 
+    if (status == 0)
+    {
+        *result = dotProduct(size, row, column);
+    }
+    return status;
+}
 
 //--------------------------------------------------------------------//
 
-void performReduceMap(int Rank, int Size, int ReducerChunkSize)
+void performReduceMap(int Rank, int Size, int sparse, ReducerOutput *output)
 {
     // Function to perform the reduce map operation
     // Inputs:
     // - Rank: rank of the current process
     // - Size: size of the matrices (Size x Size)
-    // - ReducerChunkSize: number of elements to process in each iteration
+    // - sparse: keys may lack the values of zero elements
+    // - output: this reducer's key range, receives the reduced cells
 
-    int counter = 0;
     char MachineName[MPI_MAX_PROCESSOR_NAME];
     int Len;
     MPI_Get_processor_name(MachineName, &Len);
-    // Declare variables for counting and storing the machine name of the current process
     // MPI_Get_processor_name is used to obtain the name of the processor running the current process
 
-    int n = 0;
-    // Initialize a variable n to track the index of received values
+    int group = rankThreadCount() * 16;
+    MatrixKey *Keys = (MatrixKey *)malloc(group * sizeof(MatrixKey));
+    MatrixValue **Buckets = (MatrixValue **)malloc(group * sizeof(MatrixValue *));
+    int *Counts = (int *)malloc(group * sizeof(int));
+    char *scratch = (char *)malloc(rankThreadCount() * REDUCE_SCRATCH_BYTES(Size));
+    // Keys are received a group at a time and reduced on all threads of the rank, each with its own scratch buffer
 
-    for (int i = 0, counter = 0; i < Size * Size && counter < ReducerChunkSize; i++, counter++)
+    for (int first = 0; first < output->numKeys; first += group)
     {
-        // Loop over the total number of elements in the matrices and process only a chunk of ReducerChunkSize
-
-        MatrixKey Key;
-        MatrixValue Values[Size * 2];
-        // Declare MatrixKey and MatrixValue arrays to store received keys and values
+        // Loop over the keys of this reducer's run, numKeys of them
 
-        MPI_Recv(&Key, sizeof(Key), MPI_BYTE, 0, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        // Receive a MatrixKey struct from the root process
-        // - &Key: pointer to the MatrixKey struct
-        // - sizeof(Key): size of the MatrixKey struct in bytes
-        // - MPI_BYTE: data type of the message
-        // - 0: rank of the root process
-        // - 10: message tag associated with the message
-        // - MPI_COMM_WORLD: communicator that identifies the group of processes
-        // - MPI_STATUS_IGNORE: ignore the status of the receive operation
+        int count = output->numKeys - first < group ? output->numKeys - first : group;
 
-        for (int k = 0; k < Size * 2; k++, n++)
+        enterPhase(PHASE_SHUFFLE);
+        for (int g = 0; g < count; g++)
         {
-            MatrixValue Value;
-            MPI_Recv(&Value, sizeof(Value), MPI_BYTE, 0, 20, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            // Receive a MatrixValue struct from the root process
-            // - &Value: pointer to the MatrixValue struct
-            // - sizeof(Value): size of the MatrixValue struct in bytes
-            // - MPI_BYTE: data type of the message
+            MPI_Recv(&Keys[g], sizeof(MatrixKey), MPI_BYTE, 0, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // Receive a MatrixKey struct from the root process
             // - 0: rank of the root process
-            // - 20: message tag associated with the message
-            // - MPI_COMM_WORLD: communicator that identifies the group of processes
-            // - MPI_STATUS_IGNORE: ignore the status of the receive operation
+            // - 10: message tag associated with the message
+
+            MPI_Status status;
+            int bytes = 0;
+            MPI_Probe(0, 20, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_BYTE, &bytes);
+            Counts[g] = bytes / sizeof(MatrixValue);
+            Buckets[g] = (MatrixValue *)malloc((Counts[g] + 1) * sizeof(MatrixValue));
+            // The values of a key arrive as one bucket, check its length first
+
+            MPI_Recv(Buckets[g], bytes, MPI_BYTE, 0, 20, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // Receive the bucket of MatrixValue structs from the root process (tag 20)
+        }
+
+        enterPhase(PHASE_REDUCE);
+        int faults = 0;
+        #pragma omp parallel for schedule(static) reduction(+ : faults)
+        for (int g = 0; g < count; g++)
+        {
+            int keyIndex = Keys[g].i * Size + Keys[g].k;
+            if (reduceKeyValues(Buckets[g], Counts[g], Size, sparse, scratch + rankThreadIndex() * REDUCE_SCRATCH_BYTES(Size),
+                                &output->values[keyIndex - output->firstKey]) != 0)
+            {
+                printf("Error: Output cell (%d, %d) has missing or duplicate values\n", Keys[g].i, Keys[g].k);
+                faults++;
+            }
+        }
+        // Calculate the reduced value for every key of the group
+        if (faults > 0)
+        {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+            // The other ranks wait in the output collectives, exiting alone would leave them blocked
+        }
+
+        for (int g = 0; g < count; g++)
+        {
+            free(Buckets[g]);
+        }
+    }
+
+    free(Keys);
+    free(Buckets);
+    free(Counts);
+    free(scratch);
+    printf("\nProcess %d has completed Reduce map on %s.\n", Rank, MachineName);
+}
+
+// Sets up the result buffer for reducer 'reducer', covering its run of keys
+
+void initReducerOutput(ReducerOutput *output, int reducer, int Reducers, int size)
+{
+    reducerKeyRange(reducer, Reducers, size, &output->firstKey, &output->numKeys);
+    output->values = (int *)malloc((output->numKeys + 1) * sizeof(int));
+}
+
+void freeReducerOutput(ReducerOutput *output)
+{
+    free(output->values);
+    output->values = NULL;
+    output->numKeys = 0;
+}
+
+void writeResultsCollective(int rank, int size, const ReducerOutput *output, const JobOptions *options)
+{
+    // Function to have every reducer write its cells straight into the output file, called by all ranks
+    // Inputs:
+    // - rank: rank of the current process
+    // - size: size of the matrices
+    // - output: the reducer's cells, empty on ranks that did not reduce
+    // - options: job options, the output format decides the file and its layout
+
+    long long written = writeMatrixRangeCollective(MPI_COMM_WORLD, outputFileName(options), size, options->outputFormat,
+                                                   output->firstKey, output->numKeys, output->values);
+
+    if (rank == 0)
+    {
+        if (written != (long long)size * size)
+        {
+            printf("Error: %lld of %d output cells were written\n", written, size * size);
+        }
+        printf("\nJob has been Completed");
+    }
+}
+
+
+//----------------------------------------------------------    Direct Shuffle    ----------------------------------------------------------//
+
+// Returns the index (into reducerRanks) of the reducer that owns output cell 'keyIndex' = i * size + k.
+// Reducers own consecutive runs of keys whose lengths differ by at most one, the first
+// size * size % Reducers runs are the longer ones.
+
+int reducerForKey(int keyIndex, int Reducers, int size)
+{
+    return blockOwner(keyIndex, Reducers, size * size);
+}
+
+void reducerKeyRange(int reducer, int Reducers, int size, int *firstKey, int *numKeys)
+{
+    *firstKey = blockStart(reducer, Reducers, size * size);
+    *numKeys = blockLength(reducer, Reducers, size * size);
+}
+
+// Builds a communicator holding only the mapper ranks (1..Mappers), in rank order.
+// Every other rank gets MPI_COMM_NULL.
+
+MPI_Comm createWorkerCommunicator(int rank, int Mappers)
+{
+    MPI_Comm workerComm;
+    int color = (rank >= 1 && rank <= Mappers) ? 0 : MPI_UNDEFINED;
+    MPI_Comm_split(MPI_COMM_WORLD, color, rank, &workerComm);
+    return workerComm;
+}
+
+//--------------------------------------------------------------------//
+
+// Appends a pair to the batch without sending, growing the buffers when needed
+
+void appendPair(PairBatch *batch, const MatrixKey *key, const MatrixValue *value)
+{
+    if (batch->count == batch->capacity)
+    {
+        batch->capacity = batch->capacity > 0 ? batch->capacity * 2 : 1024;
+        batch->keys = (MatrixKey *)realloc(batch->keys, batch->capacity * sizeof(MatrixKey));
+        batch->values = (MatrixValue *)realloc(batch->values, batch->capacity * sizeof(MatrixValue));
+    }
+    batch->keys[batch->count] = *key;
+    batch->values[batch->count] = *value;
+    batch->count++;
+}
+
+void groupPairsByKey(const MatrixKey *keys, const MatrixValue *values, int count, int firstKey, int numKeys, int size, int *offsets, MatrixValue *grouped)
+{
+    // Function to bucket key-value pairs by output cell with a counting sort
+    // Inputs:
+    // - keys, values: the pairs to group, 'count' of them
+    // - firstKey: key index (i * size + k) of the first bucket
+    // - numKeys: number of buckets
+    // - size: size of the matrices
+    // - offsets: receives numKeys + 1 entries, bucket q is grouped[offsets[q] .. offsets[q + 1])
+    // - grouped: receives the values ordered by key
+
+    memset(offsets, 0, (numKeys + 1) * sizeof(int));
+    for (int p = 0; p < count; p++)
+    {
+        offsets[keys[p].i * size + keys[p].k - firstKey + 1]++;
+    }
+    // Count the values of every key
+
+    for (int q = 0; q < numKeys; q++)
+    {
+        offsets[q + 1] += offsets[q];
+    }
+    // Turn the counts into bucket start positions
+
+    int *cursor = (int *)malloc(numKeys * sizeof(int));
+    memcpy(cursor, offsets, numKeys * sizeof(int));
+    for (int p = 0; p < count; p++)
+    {
+        int q = keys[p].i * size + keys[p].k - firstKey;
+        grouped[cursor[q]++] = values[p];
+    }
+    // Place every value into its bucket, keeping arrival order inside a bucket
+
+    free(cursor);
+}
+
+//--------------------------------------------------------------------//
+
+static void emitToPartition(void *context, const MatrixKey *key, const MatrixValue *value)
+{
+    DirectShuffle *shuffle = (DirectShuffle *)context;
+    int reducer = reducerForKey(key->i * shuffle->size + key->k, shuffle->Reducers, shuffle->size);
+    appendPair(&shuffle->partitions[shuffle->reducerRanks[reducer] - 1], key, value);
+}
+
+void exchangePartitions(DirectShuffle *shuffle, PairBatch *received)
+{
+    // Function to swap the partitioned pairs between all workers in one all-to-all-v exchange
+    // Inputs:
+    // - shuffle: the per-destination partitions filled by the mapper, emptied on return
+    // - received: pairs addressed to this worker are appended here
+
+    Phase previous = enterPhase(PHASE_SHUFFLE);
+    int workers = shuffle->workers;
+    int *sendCounts = (int *)malloc(workers * sizeof(int));
+    int *sendDispls = (int *)malloc(workers * sizeof(int));
+    int *recvCounts = (int *)malloc(workers * sizeof(int));
+    int *recvDispls = (int *)malloc(workers * sizeof(int));
+
+    int totalSend = 0;
+    for (int d = 0; d < workers; d++)
+    {
+        sendCounts[d] = shuffle->partitions[d].count;
+        sendDispls[d] = totalSend;
+        totalSend += sendCounts[d];
+    }
+
+    MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT, shuffle->workerComm);
+    // Every worker learns how many pairs it will get from every other worker
+
+    int totalRecv = 0;
+    for (int d = 0; d < workers; d++)
+    {
+        recvDispls[d] = totalRecv;
+        totalRecv += recvCounts[d];
+    }
 
-            Values[k] = Value;
-            // Store the received value in the Values array
+    MatrixKey *sendKeys = (MatrixKey *)malloc((totalSend + 1) * sizeof(MatrixKey));
+    MatrixValue *sendValues = (MatrixValue *)malloc((totalSend + 1) * sizeof(MatrixValue));
+    for (int d = 0; d < workers; d++)
+    {
+        memcpy(&sendKeys[sendDispls[d]], shuffle->partitions[d].keys, sendCounts[d] * sizeof(MatrixKey));
+        memcpy(&sendValues[sendDispls[d]], shuffle->partitions[d].values, sendCounts[d] * sizeof(MatrixValue));
+        shuffle->partitions[d].count = 0;
+    }
+    // Pack the partitions back to back in destination order
+
+    while (received->capacity < received->count + totalRecv)
+    {
+        received->capacity = received->capacity > 0 ? received->capacity * 2 : 1024;
+    }
+    received->keys = (MatrixKey *)realloc(received->keys, received->capacity * sizeof(MatrixKey));
+    received->values = (MatrixValue *)realloc(received->values, received->capacity * sizeof(MatrixValue));
+
+    MPI_Alltoallv(sendKeys, sendCounts, sendDispls, shuffle->keyType,
+                  &received->keys[received->count], recvCounts, recvDispls, shuffle->keyType, shuffle->workerComm);
+    MPI_Alltoallv(sendValues, sendCounts, sendDispls, shuffle->valueType,
+                  &received->values[received->count], recvCounts, recvDispls, shuffle->valueType, shuffle->workerComm);
+    // Exchange keys and values, each worker's share lands directly after what it already holds
+    received->count += totalRecv;
+
+    free(sendKeys);
+    free(sendValues);
+    free(sendCounts);
+    free(sendDispls);
+    free(recvCounts);
+    free(recvDispls);
+    enterPhase(previous);
+}
+
+//--------------------------------------------------------------------//
+
+void reduceReceivedPairs(int rank, int size, int sparse, const PairBatch *received, ReducerOutput *output)
+{
+    // Function to reduce all pairs a reducer collected during the direct shuffle
+    // Inputs:
+    // - rank: rank of the current process
+    // - size: size of the matrices
+    // - sparse: keys may lack the values of zero elements
+    // - received: every pair addressed to this reducer
+    // - output: this reducer's key range, receives the reduced cells
+
+    int firstKey = output->firstKey;
+    int numKeys = output->numKeys;
+
+    int *offsets = (int *)malloc((numKeys + 1) * sizeof(int));
+    MatrixValue *grouped = (MatrixValue *)malloc((received->count + 1) * sizeof(MatrixValue));
+    char *scratch = (char *)malloc(rankThreadCount() * REDUCE_SCRATCH_BYTES(size));
+    enterPhase(PHASE_SHUFFLE);
+    groupPairsByKey(received->keys, received->values, received->count, firstKey, numKeys, size, offsets, grouped);
+    // Bucket the received values by output cell
+
+    enterPhase(PHASE_REDUCE);
+    int faults = 0;
+    #pragma omp parallel for schedule(static) reduction(+ : faults)
+    for (int q = 0; q < numKeys; q++)
+    {
+        if (reduceKeyValues(&grouped[offsets[q]], offsets[q + 1] - offsets[q], size, sparse, scratch + rankThreadIndex() * REDUCE_SCRATCH_BYTES(size),
+                            &output->values[q]) != 0)
+        {
+            printf("Error: Output cell (%d, %d) has missing or duplicate values\n", (firstKey + q) / size, (firstKey + q) % size);
+            faults++;
         }
+    }
+    // Reduce every key on all threads of the rank
+    if (faults > 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        // The other ranks wait in the output collectives, exiting alone would leave them blocked
+    }
+
+    free(offsets);
+    free(grouped);
+    free(scratch);
 
-        int val = 0;
-        int m = 0;
-        while (m < Size)
+    char MachineName[MPI_MAX_PROCESSOR_NAME];
+    int Len;
+    MPI_Get_processor_name(MachineName, &Len);
+    printf("\nProcess %d has completed Reduce map on %s.\n", rank, MachineName);
+}
+
+void processTaskMapDirect(int rank, int size, int *reducerRanks, int Reducers, MPI_Comm workerComm, const JobOptions *options, MapperInput *input, ReducerOutput *output)
+{
+    // Function to map rows and shuffle the pairs straight to their reducers, bypassing the master
+    // Inputs:
+    // - rank: rank of the current process, a mapper
+    // - size: size of the matrices
+    // - reducerRanks, Reducers: reducer layout, decides where each key goes
+    // - workerComm: communicator of all mappers, see createWorkerCommunicator
+    // - options: job options, the map mode decides what the mapper emits
+    // - input: the mapper's rows, read collectively or received from the master
+    // - output: receives the reduced cells when this mapper is also a reducer
+
+    char *machineName = malloc(MPI_MAX_PROCESSOR_NAME * sizeof(char));
+    int nameLength;
+    MPI_Get_processor_name(machineName, &nameLength);
+    printReceivedTask(rank, machineName);
+
+    DirectShuffle shuffle;
+    shuffle.size = size;
+    shuffle.reducerRanks = reducerRanks;
+    shuffle.Reducers = Reducers;
+    shuffle.workerComm = workerComm;
+    MPI_Comm_size(workerComm, &shuffle.workers);
+    shuffle.partitions = (PairBatch *)malloc(shuffle.workers * sizeof(PairBatch));
+    for (int d = 0; d < shuffle.workers; d++)
+    {
+        initPairBatch(&shuffle.partitions[d], 0);
+    }
+    MPI_Type_contiguous(sizeof(MatrixKey), MPI_BYTE, &shuffle.keyType);
+    MPI_Type_contiguous(sizeof(MatrixValue), MPI_BYTE, &shuffle.valueType);
+    MPI_Type_commit(&shuffle.keyType);
+    MPI_Type_commit(&shuffle.valueType);
+    // One partition per worker, worker d is world rank d + 1
+
+    PairBatch received;
+    initPairBatch(&received, 0);
+
+    Matrix *blockA = input->blockA;
+    Matrix *blockB = input->blockB;
+    int rows = input->rows;
+
+    if (options->mapMode == MAP_OUTER)
+    {
+        awaitRows(input, rows);
+        Matrix *partial = allocateMatrix(size, size);
+        combineOuterProducts(blockA, blockB, partial);
+        emitPartialSums(size, rank, partial, options->sparse, emitToPartition, &shuffle);
+        exchangePartitions(&shuffle, &received);
+        freeMatrix(partial);
+        // Partial sums are exchanged once, after the whole block is combined
+    }
+    else
+    {
+        int group = rankThreadCount();
+        PairBatch *slices = (PairBatch *)malloc(group * sizeof(PairBatch));
+        for (int g = 0; g < group; g++)
         {
-            int temp = 1;
-            int n = 0;
-            while (n < Size * 2)
+            initPairBatch(&slices[g], size * size * 2);
+        }
+
+        int maxRows = blockLength(0, shuffle.workers, size);
+        for (int ind = 0; ind < maxRows; ind += group)
+        {
+            // The exchange runs once per group in lockstep. The first mappers may hold one row more
+            // than the others, so every mapper joins as many rounds as the largest block needs,
+            // with nothing to add once its own rows are done
+
+            int count = rows - ind < group ? rows - ind : group;
+            count = count > 0 ? count : 0;
+            if (count > 0)
             {
-                if (Values[n].j == m)
+                awaitRows(input, ind + count);
+                mapRowGroup(size, input->firstRow, ind, count, blockA, blockB, options->sparse, slices);
+            }
+            for (int g = 0; g < count; g++)
+            {
+                for (int p = 0; p < slices[g].count; p++)
                 {
-                    temp *= Values[n].val;
+                    emitToPartition(&shuffle, &slices[g].keys[p], &slices[g].values[p]);
                 }
-                n++;
             }
-            val += temp;
-            m++;
+            // Partition the pairs of the rows by the reducer that owns their key
+
+            exchangePartitions(&shuffle, &received);
         }
-        // Calculate the reduced value for the given key and values
 
-        ReducerKeyValue KeyValue;
-        KeyValue.row = Key.i;
-        KeyValue.col = Key.k;
-        KeyValue.value = val;
-        // Create a ReducerKeyValue struct and assign the calculated values
+        for (int g = 0; g < group; g++)
+        {
+            freePairBatch(&slices[g]);
+        }
+        free(slices);
+    }
+
+    if (options->verify == VERIFY_EXACT)
+    {
+        freeMapperInput(input);   // the Freivalds check reads the rows again once the result is out
+    }
+
+    printCompletedTask(rank, machineName);
 
-        MPI_Send(&KeyValue, sizeof(ReducerKeyValue), MPI_BYTE, 0, 5, MPI_COMM_WORLD);
-        // Send the ReducerKeyValue struct to the root process
+    for (int d = 0; d < shuffle.workers; d++)
+    {
+        freePairBatch(&shuffle.partitions[d]);
+    }
+    free(shuffle.partitions);
+    MPI_Type_free(&shuffle.keyType);
+    MPI_Type_free(&shuffle.valueType);
 
+    for (int reducer = 0; reducer < Reducers; reducer++)
+    {
+        if (reducerRanks[reducer] == rank)
+        {
+            printf("Process %d received task reduce on %s.\n", rank, machineName);
+            initReducerOutput(output, reducer, Reducers, size);
+            reduceReceivedPairs(rank, size, options->sparse, &received, output);
+        }
     }
-    printf("\nProcess %d has completed Reduce map on %s.\n", Rank, MachineName);
+
+    freePairBatch(&received);
+    free(machineName);
 }
 
 
@@ -6,6 +6,7 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<mpi.h>
 
 
 #ifndef MATRIX_OPERATIONS_H
@@ -27,44 +28,197 @@ typedef struct {
     int val;
 } MatrixValue;
 
+#define REDUCE_SCRATCH_BYTES(size) (2 * (size_t)(size) * sizeof(MatrixValue))   // working memory of one reduceKeyValues call
+
+typedef struct {
+    int rows;
+    int cols;
+    int stride;             // ints from the start of one row to the next, allocated matrices pad it to a multiple of 16
+    int* data;              // row-major elements, row r starts at data + r * stride
+    size_t bytes;           // length of the allocation or mapping, 0 for a view into memory owned elsewhere
+    void* mapping;          // start of the mmap'd region (huge pages or a binary file), NULL for heap memory
+} Matrix;
+
+#define MATRIX_ALIGNMENT 64
+#define MATRIX_ROW(matrix, r) ((matrix)->data + (size_t)(r) * (matrix)->stride)
+#define MATRIX_AT(matrix, r, c) (MATRIX_ROW(matrix, r)[c])
+
+typedef enum {
+    SHUFFLE_MASTER,         // mappers send every pair to rank 0, which regroups them for the reducers
+    SHUFFLE_DIRECT,         // mappers partition pairs by reducer and exchange them with each other
+    SHUFFLE_STREAM          // mappers stream pairs to the reducers with nonblocking sends, see stream_pipeline.c
+} ShuffleMode;
+
+typedef enum {
+    MAP_ROW,                // mapper gets row r of A and B and emits every element as a pair
+    MAP_OUTER               // mapper gets column k of A and row k of B and emits combined partial sums
+} MapMode;
+
+typedef enum {
+    FORMAT_TEXT,            // whitespace separated values, one row per line
+    FORMAT_BINARY,          // header plus raw int32 elements, see matrix_file.h
+    FORMAT_COORDINATE       // MatrixMarket coordinate, nonzero elements only
+} MatrixFileFormat;
+
+typedef enum {
+    INPUT_COLLECTIVE,       // every rank reads its own block of the input files with MPI-IO
+    INPUT_MASTER,           // the master reads the input files and sends the blocks out
+    INPUT_SHARED,           // one rank per node reads the node's rows into shared memory, see node_memory.c
+    INPUT_RMA               // the master exposes the input as RMA windows, mappers fetch their rows, see rma_input.c
+} InputMode;
+
+typedef enum {
+    OUTPUT_COLLECTIVE,      // every process writes its result cells into the output file with MPI-IO
+    OUTPUT_MASTER           // results are sent to the master, which writes the output file
+} OutputMode;
+
+typedef enum {
+    SCHEDULE_STATIC,        // every mapper gets one fixed block of rows, reducers one fixed run of keys
+    SCHEDULE_DYNAMIC        // idle workers ask the master for the next task, see task_scheduler.c
+} ScheduleMode;
+
+typedef enum {
+    ENGINE_MAPREDUCE,       // master / mapper / reducer pipeline
+    ENGINE_SUMMA,           // 2D block-distributed SUMMA, see summa_engine.c
+    ENGINE_CANNON           // Cannon's algorithm on a square process grid, see cannon_engine.c
+} EngineMode;
+
+typedef enum {
+    VERIFY_FREIVALDS,       // distributed randomized check of A * (B * r) against C * r, see result_verify.c
+    VERIFY_EXACT            // the master re-reads the files and recomputes the whole product serially
+} VerifyMode;
+
+typedef struct {
+    EngineMode engine;
+    int panelWidth;         // SUMMA panel width in columns
+    int threads;            // threads per rank for the map, reduce and multiply loops
+    int batchSize;          // key-value pairs per mapper message, 0 = one message per matrix row
+    ShuffleMode shuffle;
+    MapMode mapMode;
+    long memoryBudgetMB;    // memory the master may use for intermediate pairs before spilling
+    const char* scratchDir; // where spilled runs are written
+    int hugePages;          // back matrices with huge pages where the system allows it
+    MatrixFileFormat outputFormat;
+    InputMode input;
+    OutputMode output;
+    int streamWindow;       // messages each rank keeps in flight in the streaming shuffle
+    ScheduleMode schedule;
+    int taskRows;           // rows per dynamic map task, 0 = chosen from the size and worker count
+    int taskKeys;           // output cells per dynamic reduce task, 0 = chosen likewise
+    int sparse;             // mappers emit nonzero elements only, set for MatrixMarket input
+    const char* timingsFile; // CSV file the phase times of the run are appended to, NULL for none
+    VerifyMode verify;
+    int verifyRounds;       // random vectors the Freivalds check multiplies by, each at least halves the chance of missing an error
+} JobOptions;
+
+typedef struct RowFetch RowFetch;   // see rma_input.h
+
+typedef struct {
+    int firstRow;           // matrix row held in row 0 of the blocks
+    int rows;               // rows of the matrices assigned to the mapper
+    Matrix* blockA;         // those rows of A, or a size x rows block of its columns in outer product mode
+    Matrix* blockB;         // those rows of B
+    RowFetch* fetch;        // gets still filling the blocks with --input=rma, NULL once every row is in
+} MapperInput;
+
+typedef struct {
+    int firstKey;           // output cell i * size + k held in values[0]
+    int numKeys;
+    int* values;            // reduced cells firstKey .. firstKey + numKeys in row-major order
+} ReducerOutput;
+
+typedef struct {
+    MatrixKey* keys;
+    MatrixValue* values;
+    int count;
+    int capacity;
+} PairBatch;
+
+typedef struct IntermediateStore IntermediateStore;   // see intermediate_store.h
+
+typedef void (*PairEmitter)(void* context, const MatrixKey* key, const MatrixValue* value);
+
 typedef struct {
-    int row;
-    int col;
-    int value;
-} ReducerKeyValue;
+    PairBatch* partitions;  // one per worker, indexed by worker rank (world rank - 1)
+    int workers;
+    int size;
+    int* reducerRanks;
+    int Reducers;
+    MPI_Comm workerComm;
+    MPI_Datatype keyType;
+    MPI_Datatype valueType;
+} DirectShuffle;
 
 
 // ---------------------------------
 // Function Declarations
 // ---------------------------------
 
-int readCommandLineArguments(int argc, char** argv, char** inputFile1, char** inputFile2, int* MatrixSize);
-void fillMatrixWithZeros(int** matrix, int size, int row);
-int** readMatrixFromFile(char* filename, int size);
-int** allocateMatrix(int size);
-void freeMatrix(int** matrix, int size);
-void multiplyMatrices(int** result, int** matrix1, int** matrix2, int size);
+int readCommandLineArguments(int argc, char** argv, char** inputFile1, char** inputFile2, int* MatrixSize, JobOptions* options);
+int configureThreads(int threads, int providedThreadLevel);
+int rankThreadCount(void);
+int rankThreadIndex(void);
+int resolveBatchSize(const JobOptions* options, int size);
+void setMatrixHugePages(int enabled);
+Matrix* allocateMatrix(int rows, int cols);
+void fillMatrixWithZeros(Matrix* matrix);
+Matrix* readMatrixFromFile(char* filename, int size);
+void freeMatrix(Matrix* matrix);
+MPI_Datatype createMatrixBlockType(const Matrix* matrix, int rows, int cols);
+void multiplyMatrices(Matrix* result, const Matrix* matrix1, const Matrix* matrix2);
 bool compareMatrices(char* file1, char* file2, char* file3, int size);
+int blockStart(int index, int parts, int total);
+int blockLength(int index, int parts, int total);
+int blockOwner(int position, int parts, int total);
+void packMatrixBlock(const Matrix* matrix, int rowStart, int rows, int colStart, int cols, int* buffer);
+void unpackMatrixBlock(Matrix* matrix, const int* buffer, int rowStart, int rows, int colStart, int cols);
 void printReducerRanks(int* reducerRanks, int numOfReducers);
 void printProcessorCount(int numOfProcess);
 void printReducerCount(int numOfReducers);
 void printReducerChunkSize(int reducerChunkSize);
-void populateMatricesFromFile(char* file1, char* file2, int size, int*** matrix1, int*** matrix2);
+void printDistribution(int Mappers, int Reducers, int size);
+void printBatchSize(int batchSize);
+void populateMatricesFromFile(char* file1, char* file2, int size, Matrix** matrix1, Matrix** matrix2);
 void printMasterDetails(int rank, char* machineName);
-void sendMatrixRowsToMappers(int rank, int Mappers, int chunkSize, int size, int** matrix1, int** matrix2);
-void freeMasterResources(int** matrix1, int** matrix2, char* machineName, int Size);
+void sendMatrixRowsToMappers(int Mappers, int size, const Matrix* matrix1, const Matrix* matrix2, MapMode mapMode);
+void freeMasterResources(Matrix* matrix1, Matrix* matrix2, char* machineName);
 void printReceivedTask(int rank, const char* machineName);
-void receiveData(int rank, int size, int* row, int** matrix1, int** matrix2);
-void sendMapperData(const MatrixKey* key, const MatrixValue* value);
-void freeData(int* matrix1, int* matrix2);
+void receiveRowBlock(int size, MapMode mapMode, MapperInput* input);
+void readRowBlocksCollective(int rank, int Mappers, int size, char* inputFile1, char* inputFile2, MapMode mapMode, MapperInput* input);
+void freeMapperInput(MapperInput* input);
+void sendMapperData(const MatrixKey* keys, const MatrixValue* values, int count);
+void initPairBatch(PairBatch* batch, int capacity);
+void emitPair(PairBatch* batch, const MatrixKey* key, const MatrixValue* value);
+void flushPairBatch(PairBatch* batch);
+void freePairBatch(PairBatch* batch);
 void printCompletedTask(int rank, const char* machineName);
-void processTaskMap(int rank, int dropout, int chunkSize, int size);
-void receiveMapperData(int source, MatrixKey* key, MatrixValue* value);
-void assignReduceTask(int rank, int* reducerRanks, int reducerChunkSize, int size, MatrixKey* keys, MatrixValue* values);
-int* initializeReducerRanks(int Reducers, int totalproc);
-void validateMapperConfiguration(int Size, int Mappers, int totalproc, int* dropout);
-void writeResultToFile(int Rank, int Size, int** outputarr, char* File1, char* File2);
-void performReduceMap(int Rank, int Size, int ReducerChunkSize);
+void mapRowToPairs(int row, int size, const int* matrixA, const int* matrixB, int sparse, PairEmitter emit, void* context);
+void combineOuterProducts(const Matrix* columnsA, const Matrix* rowsB, Matrix* partial);
+void mapRowGroup(int size, int firstRow, int start, int count, const Matrix* blockA, const Matrix* blockB, int sparse, PairBatch* slices);
+void emitPartialSums(int size, int mapper, const Matrix* partial, int sparse, PairEmitter emit, void* context);
+long long pairsPerMapper(int rows, int size, MapMode mapMode);
+void processTaskMap(int rank, int size, const JobOptions* options, MapperInput* input);
+int receiveMapperData(int source, MatrixKey* keys, MatrixValue* values);
+void assignReduceTask(int* reducerRanks, int Reducers, int size, IntermediateStore* store);
+int* initializeReducerRanks(int Reducers);
+void writeResultToFile(int Rank, int Size, Matrix* outputarr, const JobOptions* options, const ReducerOutput* output);
+void writeMatrixToFile(char* filename, const Matrix* matrix);
+char* outputFileName(const JobOptions* options);
+void writeOutputMatrix(const Matrix* matrix, const JobOptions* options);
+void printMatrixComparison(char* File1, char* File2, char* OutputFile, int size);
+int reduceKeyValues(const MatrixValue* values, int count, int size, int sparse, void* scratch, int* result);
+void performReduceMap(int Rank, int Size, int sparse, ReducerOutput* output);
+void initReducerOutput(ReducerOutput* output, int reducer, int Reducers, int size);
+void freeReducerOutput(ReducerOutput* output);
+void writeResultsCollective(int rank, int size, const ReducerOutput* output, const JobOptions* options);
+int reducerForKey(int keyIndex, int Reducers, int size);
+void reducerKeyRange(int reducer, int Reducers, int size, int* firstKey, int* numKeys);
+MPI_Comm createWorkerCommunicator(int rank, int Mappers);
+void appendPair(PairBatch* batch, const MatrixKey* key, const MatrixValue* value);
+void groupPairsByKey(const MatrixKey* keys, const MatrixValue* values, int count, int firstKey, int numKeys, int size, int* offsets, MatrixValue* grouped);
+void exchangePartitions(DirectShuffle* shuffle, PairBatch* received);
+void reduceReceivedPairs(int rank, int size, int sparse, const PairBatch* received, ReducerOutput* output);
+void processTaskMapDirect(int rank, int size, int* reducerRanks, int Reducers, MPI_Comm workerComm, const JobOptions* options, MapperInput* input, ReducerOutput* output);
 
 
 #endif
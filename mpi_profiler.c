@@ -0,0 +1,729 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//----------------------------------------------------------    MPI Profiler    ----------------------------------------------------------//
+
+// Optional profiling layer built on the PMPI interface. Linking this file into the program (or
+// preloading it as a shared library) replaces the MPI calls the job makes with wrappers that
+// count messages and bytes and time spent blocked, then forward to the PMPI_ versions.
+// Point-to-point traffic is counted per tag and per peer, collectives and one-sided gets per
+// operation. MPI_Finalize gathers every rank's counters on rank 0, which prints a table per tag,
+// per rank and per operation, and the communication matrix of bytes moved between ranks.
+//
+//   mpicc -O2 -fopenmp -o mpiproject <sources> mpi_profiler.c
+//   mpicc -O2 -shared -fPIC -o libmpiprofiler.so mpi_profiler.c
+//   mpirun -x LD_PRELOAD=./libmpiprofiler.so -np 8 ./mpiproject ...
+//
+// Nonblocking sends are counted when posted, receives when they complete. Waiting on several
+// requests at once charges the time evenly to the requests that completed. MPI is used from the
+// main thread only (MPI_THREAD_FUNNELED), so the counters need no locking.
+
+#define PROFILE_TAGS 128            // tags 0 .. 126 are counted one by one, higher tags share the last row
+#define PROFILE_NO_TAG -1           // requests of one-sided gets, charged to their operation
+#define PROFILE_MATRIX_LIMIT 64     // larger jobs print the communication matrix as per-rank totals only
+
+typedef struct {
+    long long messages;
+    long long bytes;
+    double seconds;                 // time spent blocked
+} TrafficCounter;
+
+typedef enum {
+    OP_BARRIER,
+    OP_BCAST,
+    OP_REDUCE,
+    OP_ALLREDUCE,
+    OP_GATHER,
+    OP_GATHERV,
+    OP_ALLGATHER,
+    OP_ALLGATHERV,
+    OP_ALLTOALL,
+    OP_ALLTOALLV,
+    OP_EXSCAN,
+    OP_RGET,
+    OP_COUNT
+} ProfiledOperation;
+
+static const char *operationNames[OP_COUNT] = {"Barrier", "Bcast", "Reduce", "Allreduce", "Gather", "Gatherv",
+                                               "Allgather", "Allgatherv", "Alltoall", "Alltoallv", "Exscan", "Rget"};
+
+typedef struct {
+    MPI_Request request;
+    MPI_Comm comm;                  // communicator of a receive, to find the sender's world rank
+    int receive;
+    int tag;                        // PROFILE_NO_TAG for one-sided gets
+    int peer;                       // world rank of the destination, -1 until a receive completes
+} PendingRequest;
+
+static int worldRank = 0;
+static int worldSize = 0;
+static MPI_Group worldGroup = MPI_GROUP_NULL;
+
+static TrafficCounter sentByTag[PROFILE_TAGS];
+static TrafficCounter receivedByTag[PROFILE_TAGS];
+static TrafficCounter *sentToPeer = NULL;       // one per world rank
+static TrafficCounter *receivedFromPeer = NULL;
+static TrafficCounter operations[OP_COUNT];     // messages count the calls
+
+static PendingRequest *pending = NULL;
+static int numPending = 0;
+static int pendingCapacity = 0;
+
+//--------------------------------------------------------------------//
+
+static void initProfiler(void)
+{
+    PMPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    PMPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+    sentToPeer = (TrafficCounter *)calloc(worldSize, sizeof(TrafficCounter));
+    receivedFromPeer = (TrafficCounter *)calloc(worldSize, sizeof(TrafficCounter));
+}
+
+static int tagRow(int tag)
+{
+    return tag >= 0 && tag < PROFILE_TAGS - 1 ? tag : PROFILE_TAGS - 1;
+}
+
+static long long messageBytes(int count, MPI_Datatype datatype)
+{
+    int size = 0;
+    PMPI_Type_size(datatype, &size);
+    return (long long)count * size;
+}
+
+static int toWorldRank(MPI_Group group, int rank)
+{
+    // Function to translate a rank in 'group' to its rank in MPI_COMM_WORLD, -1 for MPI_PROC_NULL and wildcards
+
+    int world = -1;
+    if (rank >= 0)
+    {
+        PMPI_Group_translate_ranks(group, 1, &rank, worldGroup, &world);
+    }
+    return world == MPI_UNDEFINED ? -1 : world;
+}
+
+static int peerRank(MPI_Comm comm, int rank)
+{
+    if (comm == MPI_COMM_WORLD || rank < 0)
+    {
+        return rank;
+    }
+    MPI_Group group;
+    PMPI_Comm_group(comm, &group);
+    int world = toWorldRank(group, rank);
+    PMPI_Group_free(&group);
+    return world;
+}
+
+static void countSend(int peer, int tag, long long bytes, double seconds)
+{
+    TrafficCounter *byTag = &sentByTag[tagRow(tag)];
+    byTag->messages++;
+    byTag->bytes += bytes;
+    byTag->seconds += seconds;
+    if (peer >= 0 && sentToPeer != NULL)
+    {
+        sentToPeer[peer].messages++;
+        sentToPeer[peer].bytes += bytes;
+        sentToPeer[peer].seconds += seconds;
+    }
+}
+
+static void countReceive(MPI_Comm comm, const MPI_Status *status, double seconds)
+{
+    // Function to count a completed receive from its status
+
+    int cancelled = 0;
+    PMPI_Test_cancelled(status, &cancelled);
+    if (cancelled || status->MPI_SOURCE == MPI_PROC_NULL)
+    {
+        return;
+    }
+
+    int bytes = 0;
+    PMPI_Get_count(status, MPI_BYTE, &bytes);
+    int peer = peerRank(comm, status->MPI_SOURCE);
+
+    TrafficCounter *byTag = &receivedByTag[tagRow(status->MPI_TAG)];
+    byTag->messages++;
+    byTag->bytes += bytes;
+    byTag->seconds += seconds;
+    if (peer >= 0 && receivedFromPeer != NULL)
+    {
+        receivedFromPeer[peer].messages++;
+        receivedFromPeer[peer].bytes += bytes;
+        receivedFromPeer[peer].seconds += seconds;
+    }
+}
+
+static void countOperation(ProfiledOperation operation, long long bytes, double seconds)
+{
+    operations[operation].messages++;
+    operations[operation].bytes += bytes;
+    operations[operation].seconds += seconds;
+}
+
+//--------------------------------------------------------------------//
+
+static void trackRequest(MPI_Request request, MPI_Comm comm, int receive, int tag, int peer)
+{
+    if (numPending == pendingCapacity)
+    {
+        pendingCapacity = pendingCapacity > 0 ? pendingCapacity * 2 : 64;
+        pending = (PendingRequest *)realloc(pending, pendingCapacity * sizeof(PendingRequest));
+    }
+    PendingRequest *entry = &pending[numPending++];
+    entry->request = request;
+    entry->comm = comm;
+    entry->receive = receive;
+    entry->tag = tag;
+    entry->peer = peer;
+}
+
+static int findRequest(MPI_Request request)
+{
+    for (int p = 0; p < numPending; p++)
+    {
+        if (pending[p].request == request)
+        {
+            return p;
+        }
+    }
+    return -1;
+}
+
+static void completeRequests(const MPI_Request *handles, const int *indices, int done, const MPI_Status *statuses, double seconds)
+{
+    // Function to count the requests a wait or test completed and charge them the time it blocked
+    // Inputs:
+    // - handles: the request handles as they were before the call, MPI resets completed ones
+    // - indices: positions of the completed requests in 'handles', NULL when they are 0 .. done - 1
+    // - done: number of completed requests
+    // - statuses: status of every completed request, in the order of 'indices'
+    // - seconds: time the call blocked
+
+    int tracked = 0;
+    for (int d = 0; d < done; d++)
+    {
+        tracked += findRequest(handles[indices != NULL ? indices[d] : d]) >= 0;
+    }
+    double share = tracked > 0 ? seconds / tracked : 0.0;
+
+    for (int d = 0; d < done; d++)
+    {
+        int p = findRequest(handles[indices != NULL ? indices[d] : d]);
+        if (p < 0)
+        {
+            continue;
+        }
+        // Requests the profiler did not create (MPI-IO, say) are left alone
+
+        PendingRequest *entry = &pending[p];
+        if (entry->tag == PROFILE_NO_TAG)
+        {
+            operations[OP_RGET].seconds += share;
+        }
+        else if (entry->receive)
+        {
+            countReceive(entry->comm, &statuses[d], share);
+        }
+        else
+        {
+            sentByTag[tagRow(entry->tag)].seconds += share;
+            if (entry->peer >= 0)
+            {
+                sentToPeer[entry->peer].seconds += share;
+            }
+        }
+        pending[p] = pending[--numPending];
+    }
+}
+
+//----------------------------------------------------------    Wrappers    ----------------------------------------------------------//
+
+int MPI_Init(int *argc, char ***argv)
+{
+    int result = PMPI_Init(argc, argv);
+    initProfiler();
+    return result;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided)
+{
+    int result = PMPI_Init_thread(argc, argv, required, provided);
+    initProfiler();
+    return result;
+}
+
+int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Send(buf, count, datatype, dest, tag, comm);
+    countSend(peerRank(comm, dest), tag, messageBytes(count, datatype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Status *status)
+{
+    MPI_Status local;
+    MPI_Status *received = status == MPI_STATUS_IGNORE ? &local : status;
+    double start = PMPI_Wtime();
+    int result = PMPI_Recv(buf, count, datatype, source, tag, comm, received);
+    countReceive(comm, received, PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm, MPI_Request *request)
+{
+    int result = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+    int peer = peerRank(comm, dest);
+    countSend(peer, tag, messageBytes(count, datatype), 0.0);
+    trackRequest(*request, comm, 0, tag, peer);
+    return result;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Request *request)
+{
+    int result = PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+    trackRequest(*request, comm, 1, tag, -1);
+    return result;
+}
+
+int MPI_Sendrecv_replace(void *buf, int count, MPI_Datatype datatype, int dest, int sendtag, int source, int recvtag, MPI_Comm comm, MPI_Status *status)
+{
+    MPI_Status local;
+    MPI_Status *received = status == MPI_STATUS_IGNORE ? &local : status;
+    double start = PMPI_Wtime();
+    int result = PMPI_Sendrecv_replace(buf, count, datatype, dest, sendtag, source, recvtag, comm, received);
+    double seconds = PMPI_Wtime() - start;
+    countSend(peerRank(comm, dest), sendtag, messageBytes(count, datatype), seconds / 2);
+    countReceive(comm, received, seconds / 2);
+    return result;
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status *status)
+{
+    MPI_Status local;
+    MPI_Status *probed = status == MPI_STATUS_IGNORE ? &local : status;
+    double start = PMPI_Wtime();
+    int result = PMPI_Probe(source, tag, comm, probed);
+    double seconds = PMPI_Wtime() - start;
+    receivedByTag[tagRow(probed->MPI_TAG)].seconds += seconds;
+    int peer = peerRank(comm, probed->MPI_SOURCE);
+    if (peer >= 0)
+    {
+        receivedFromPeer[peer].seconds += seconds;
+    }
+    // Waiting for a message to show up is time blocked on its receive, the message is counted when received
+    return result;
+}
+
+//--------------------------------------------------------------------//
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status)
+{
+    MPI_Status local;
+    MPI_Status *completed = status == MPI_STATUS_IGNORE ? &local : status;
+    MPI_Request handle = *request;
+    double start = PMPI_Wtime();
+    int result = PMPI_Wait(request, completed);
+    completeRequests(&handle, NULL, handle != MPI_REQUEST_NULL, completed, PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Waitall(int count, MPI_Request array_of_requests[], MPI_Status *array_of_statuses)
+{
+    MPI_Request *handles = (MPI_Request *)malloc((count + 1) * sizeof(MPI_Request));
+    MPI_Status *statuses = array_of_statuses;
+    if (array_of_statuses == MPI_STATUSES_IGNORE)
+    {
+        statuses = (MPI_Status *)malloc((count + 1) * sizeof(MPI_Status));
+    }
+    memcpy(handles, array_of_requests, count * sizeof(MPI_Request));
+
+    double start = PMPI_Wtime();
+    int result = PMPI_Waitall(count, array_of_requests, statuses);
+    completeRequests(handles, NULL, count, statuses, PMPI_Wtime() - start);
+
+    if (statuses != array_of_statuses)
+    {
+        free(statuses);
+    }
+    free(handles);
+    return result;
+}
+
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *index, MPI_Status *status)
+{
+    MPI_Status local;
+    MPI_Status *completed = status == MPI_STATUS_IGNORE ? &local : status;
+    MPI_Request *handles = (MPI_Request *)malloc((count + 1) * sizeof(MPI_Request));
+    memcpy(handles, array_of_requests, count * sizeof(MPI_Request));
+
+    double start = PMPI_Wtime();
+    int result = PMPI_Waitany(count, array_of_requests, index, completed);
+    if (*index != MPI_UNDEFINED)
+    {
+        completeRequests(handles, index, 1, completed, PMPI_Wtime() - start);
+    }
+
+    free(handles);
+    return result;
+}
+
+static int profileSome(int test, int incount, MPI_Request array_of_requests[], int *outcount, int array_of_indices[], MPI_Status array_of_statuses[])
+{
+    // Function to run MPI_Waitsome or MPI_Testsome and count what completed
+
+    MPI_Request *handles = (MPI_Request *)malloc((incount + 1) * sizeof(MPI_Request));
+    MPI_Status *statuses = array_of_statuses;
+    if (array_of_statuses == MPI_STATUSES_IGNORE)
+    {
+        statuses = (MPI_Status *)malloc((incount + 1) * sizeof(MPI_Status));
+    }
+    memcpy(handles, array_of_requests, incount * sizeof(MPI_Request));
+
+    double start = PMPI_Wtime();
+    int result = test ? PMPI_Testsome(incount, array_of_requests, outcount, array_of_indices, statuses)
+                      : PMPI_Waitsome(incount, array_of_requests, outcount, array_of_indices, statuses);
+    if (*outcount != MPI_UNDEFINED)
+    {
+        completeRequests(handles, array_of_indices, *outcount, statuses, test ? 0.0 : PMPI_Wtime() - start);
+    }
+    // A test never blocks, only what it completes is counted
+
+    if (statuses != array_of_statuses)
+    {
+        free(statuses);
+    }
+    free(handles);
+    return result;
+}
+
+int MPI_Waitsome(int incount, MPI_Request array_of_requests[], int *outcount, int array_of_indices[], MPI_Status array_of_statuses[])
+{
+    return profileSome(0, incount, array_of_requests, outcount, array_of_indices, array_of_statuses);
+}
+
+int MPI_Testsome(int incount, MPI_Request array_of_requests[], int *outcount, int array_of_indices[], MPI_Status array_of_statuses[])
+{
+    return profileSome(1, incount, array_of_requests, outcount, array_of_indices, array_of_statuses);
+}
+
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status)
+{
+    MPI_Status local;
+    MPI_Status *completed = status == MPI_STATUS_IGNORE ? &local : status;
+    MPI_Request handle = *request;
+    int result = PMPI_Test(request, flag, completed);
+    completeRequests(&handle, NULL, *flag && handle != MPI_REQUEST_NULL, completed, 0.0);
+    return result;
+}
+
+int MPI_Cancel(MPI_Request *request)
+{
+    int p = findRequest(*request);
+    if (p >= 0 && !pending[p].receive)
+    {
+        pending[p] = pending[--numPending];
+    }
+    // A cancelled receive still completes in a wait and is dropped there, its status says it was cancelled
+    return PMPI_Cancel(request);
+}
+
+//--------------------------------------------------------------------//
+
+int MPI_Barrier(MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Barrier(comm);
+    countOperation(OP_BARRIER, 0, PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Bcast(buffer, count, datatype, root, comm);
+    countOperation(OP_BCAST, messageBytes(count, datatype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm);
+    countOperation(OP_REDUCE, messageBytes(count, datatype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+    countOperation(OP_ALLREDUCE, messageBytes(count, datatype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+    countOperation(OP_GATHER, messageBytes(sendcount, sendtype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Gatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm);
+    countOperation(OP_GATHERV, messageBytes(sendcount, sendtype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    countOperation(OP_ALLGATHER, messageBytes(sendcount, sendtype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int displs[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm);
+    countOperation(OP_ALLGATHERV, messageBytes(sendcount, sendtype), PMPI_Wtime() - start);
+    return result;
+}
+
+static void countExchange(MPI_Comm comm, const int *sendcounts, int sendcount, MPI_Datatype sendtype, const int *recvcounts, int recvcount, MPI_Datatype recvtype)
+{
+    // Function to add an all-to-all exchange to the communication matrix, peer by peer
+    // The exchange is the shuffle itself with --shuffle=direct, so it belongs in the matrix with the point-to-point traffic
+
+    int size, rank;
+    PMPI_Comm_size(comm, &size);
+    PMPI_Comm_rank(comm, &rank);
+    for (int d = 0; d < size; d++)
+    {
+        int peer = peerRank(comm, d);
+        if (d == rank || peer < 0)
+        {
+            continue;
+        }
+        long long sent = messageBytes(sendcounts != NULL ? sendcounts[d] : sendcount, sendtype);
+        long long received = messageBytes(recvcounts != NULL ? recvcounts[d] : recvcount, recvtype);
+        sentToPeer[peer].messages += sent > 0;
+        sentToPeer[peer].bytes += sent;
+        receivedFromPeer[peer].messages += received > 0;
+        receivedFromPeer[peer].bytes += received;
+    }
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    int size;
+    PMPI_Comm_size(comm, &size);
+    double start = PMPI_Wtime();
+    int result = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    countOperation(OP_ALLTOALL, messageBytes(sendcount, sendtype) * size, PMPI_Wtime() - start);
+    countExchange(comm, NULL, sendcount, sendtype, NULL, recvcount, recvtype);
+    return result;
+}
+
+int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype, void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+    int size;
+    PMPI_Comm_size(comm, &size);
+    long long total = 0;
+    for (int d = 0; d < size; d++)
+    {
+        total += messageBytes(sendcounts[d], sendtype);
+    }
+    double start = PMPI_Wtime();
+    int result = PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm);
+    countOperation(OP_ALLTOALLV, total, PMPI_Wtime() - start);
+    countExchange(comm, sendcounts, 0, sendtype, recvcounts, 0, recvtype);
+    return result;
+}
+
+int MPI_Exscan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+    double start = PMPI_Wtime();
+    int result = PMPI_Exscan(sendbuf, recvbuf, count, datatype, op, comm);
+    countOperation(OP_EXSCAN, messageBytes(count, datatype), PMPI_Wtime() - start);
+    return result;
+}
+
+int MPI_Rget(void *origin_addr, int origin_count, MPI_Datatype origin_datatype, int target_rank, MPI_Aint target_disp, int target_count, MPI_Datatype target_datatype, MPI_Win win, MPI_Request *request)
+{
+    int result = PMPI_Rget(origin_addr, origin_count, origin_datatype, target_rank, target_disp, target_count, target_datatype, win, request);
+    long long bytes = messageBytes(origin_count, origin_datatype);
+    countOperation(OP_RGET, bytes, 0.0);
+
+    MPI_Group group;
+    PMPI_Win_get_group(win, &group);
+    int peer = toWorldRank(group, target_rank);
+    PMPI_Group_free(&group);
+    if (peer >= 0)
+    {
+        receivedFromPeer[peer].messages++;
+        receivedFromPeer[peer].bytes += bytes;
+    }
+    // A get moves data from the target to this rank, like a receive that the target never posts
+
+    trackRequest(*request, MPI_COMM_NULL, 1, PROFILE_NO_TAG, peer);
+    return result;
+}
+
+//----------------------------------------------------------    Summary    ----------------------------------------------------------//
+
+static void printTagTable(const double *tags)
+{
+    // Function to print the traffic of every tag that was used, summed over all ranks
+    // tags holds 6 values per tag: sent messages, bytes, seconds, then received messages, bytes, seconds
+
+    printf("\nMPI profile: point-to-point traffic by tag, all ranks\n");
+    printf("%6s  %12s  %14s  %10s  %12s  %14s  %10s\n", "tag", "sent msgs", "sent bytes", "send wait", "recv msgs", "recv bytes", "recv wait");
+    for (int t = 0; t < PROFILE_TAGS; t++)
+    {
+        const double *row = &tags[6 * t];
+        if (row[0] == 0 && row[3] == 0 && row[2] == 0 && row[5] == 0)
+        {
+            continue;
+        }
+        char tag[16];
+        snprintf(tag, sizeof(tag), t == PROFILE_TAGS - 1 ? ">=%d" : "%d", t);
+        printf("%6s  %12.0f  %14.0f  %9.4fs  %12.0f  %14.0f  %9.4fs\n", tag, row[0], row[1], row[2], row[3], row[4], row[5]);
+    }
+}
+
+static void printRankTable(const double *ranks)
+{
+    // ranks holds 6 values per rank: sent messages, bytes, received messages, bytes, point-to-point wait, collective time
+
+    printf("\nMPI profile: traffic by rank\n");
+    printf("%6s  %12s  %14s  %12s  %14s  %10s  %11s\n", "rank", "sent msgs", "sent bytes", "recv msgs", "recv bytes", "p2p wait", "collectives");
+    for (int r = 0; r < worldSize; r++)
+    {
+        const double *row = &ranks[6 * r];
+        printf("%6d  %12.0f  %14.0f  %12.0f  %14.0f  %9.4fs  %10.4fs\n", r, row[0], row[1], row[2], row[3], row[4], row[5]);
+    }
+}
+
+static void printOperationTable(const double *calls, const double *bytes, const double *seconds)
+{
+    printf("\nMPI profile: collectives and one-sided gets, all ranks (time is the slowest rank)\n");
+    printf("%12s  %10s  %14s  %10s\n", "operation", "calls", "bytes", "time");
+    for (int o = 0; o < OP_COUNT; o++)
+    {
+        if (calls[o] > 0)
+        {
+            printf("%12s  %10.0f  %14.0f  %9.4fs\n", operationNames[o], calls[o], bytes[o], seconds[o]);
+        }
+    }
+}
+
+static void printCommunicationMatrix(const long long *matrix)
+{
+    // Function to print the bytes every rank (row) delivered to every other rank (column)
+    // Row r of 'matrix' holds what rank r received, so one-sided gets count for the rank read from
+
+    printf("\nMPI profile: communication matrix, bytes moved from row rank to column rank\n");
+    if (worldSize > PROFILE_MATRIX_LIMIT)
+    {
+        printf("(%d ranks, only the traffic by rank above is printed)\n", worldSize);
+        return;
+    }
+    printf("%6s", "");
+    for (int c = 0; c < worldSize; c++)
+    {
+        printf(" %11d", c);
+    }
+    printf("\n");
+    for (int r = 0; r < worldSize; r++)
+    {
+        printf("%6d", r);
+        for (int c = 0; c < worldSize; c++)
+        {
+            printf(" %11lld", matrix[(size_t)c * worldSize + r]);
+        }
+        printf("\n");
+    }
+}
+
+int MPI_Finalize(void)
+{
+    // Every rank sends its counters to rank 0, which prints the summary before MPI shuts down
+
+    double tags[6 * PROFILE_TAGS];
+    for (int t = 0; t < PROFILE_TAGS; t++)
+    {
+        double row[6] = {sentByTag[t].messages, sentByTag[t].bytes, sentByTag[t].seconds,
+                         receivedByTag[t].messages, receivedByTag[t].bytes, receivedByTag[t].seconds};
+        memcpy(&tags[6 * t], row, sizeof(row));
+    }
+
+    double mine[6] = {0, 0, 0, 0, 0, 0};
+    long long *receivedBytes = (long long *)malloc((worldSize + 1) * sizeof(long long));
+    for (int peer = 0; peer < worldSize; peer++)
+    {
+        mine[0] += sentToPeer[peer].messages;
+        mine[1] += sentToPeer[peer].bytes;
+        mine[2] += receivedFromPeer[peer].messages;
+        mine[3] += receivedFromPeer[peer].bytes;
+        mine[4] += sentToPeer[peer].seconds + receivedFromPeer[peer].seconds;
+        receivedBytes[peer] = receivedFromPeer[peer].bytes;
+    }
+    double calls[OP_COUNT], bytes[OP_COUNT], seconds[OP_COUNT];
+    for (int o = 0; o < OP_COUNT; o++)
+    {
+        calls[o] = operations[o].messages;
+        bytes[o] = operations[o].bytes;
+        seconds[o] = operations[o].seconds;
+        mine[5] += o != OP_RGET ? operations[o].seconds : 0.0;
+    }
+    mine[4] += operations[OP_RGET].seconds;
+    // Waiting for a get is point-to-point wait, all other operations are collectives
+
+    int root = worldRank == 0;
+    double *allTags = root ? (double *)malloc(6 * PROFILE_TAGS * sizeof(double)) : NULL;
+    double *allRanks = root ? (double *)malloc(6 * worldSize * sizeof(double)) : NULL;
+    long long *matrix = root ? (long long *)malloc(((size_t)worldSize * worldSize + 1) * sizeof(long long)) : NULL;
+    double allCalls[OP_COUNT], allBytes[OP_COUNT], slowest[OP_COUNT];
+
+    PMPI_Reduce(tags, allTags, 6 * PROFILE_TAGS, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Gather(mine, 6, MPI_DOUBLE, allRanks, 6, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    PMPI_Gather(receivedBytes, worldSize, MPI_LONG_LONG, matrix, worldSize, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(calls, allCalls, OP_COUNT, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(bytes, allBytes, OP_COUNT, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(seconds, slowest, OP_COUNT, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    // The profiler's own traffic goes through PMPI and is not counted
+
+    if (root)
+    {
+        printTagTable(allTags);
+        printRankTable(allRanks);
+        printOperationTable(allCalls, allBytes, slowest);
+        printCommunicationMatrix(matrix);
+        fflush(stdout);
+    }
+
+    free(allTags);
+    free(allRanks);
+    free(matrix);
+    free(receivedBytes);
+    free(sentToPeer);
+    free(receivedFromPeer);
+    free(pending);
+    PMPI_Group_free(&worldGroup);
+    return PMPI_Finalize();
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
@@ -0,0 +1,215 @@
+#include "node_memory.h"
+#include "matrix_mpiio.h"
+
+//----------------------------------------------------------    Node Shared Input    ----------------------------------------------------------//
+
+// Ranks on the same node share one copy of the node's input. The node's first rank allocates
+// an MPI-3 shared-memory window and reads the rows of every mapper on the node into it, with
+// one collective MPI-IO read across all nodes. The mappers then work on views into that
+// window, so their rows are neither read nor copied again. This needs the ranks of a node to
+// hold adjacent rows, as they do with the usual by-slot placement; otherwise every rank reads
+// its own rows as with --input=collective.
+
+static Matrix *sharedView(int *data, int rows, int cols, int stride)
+{
+    Matrix *view = (Matrix *)malloc(sizeof(Matrix));
+    view->rows = rows;
+    view->cols = cols;
+    view->stride = stride;
+    view->data = data;
+    view->bytes = 0;
+    view->mapping = NULL;
+    return view;
+    // bytes = 0 marks memory owned elsewhere, freeMatrix leaves it alone
+}
+
+static int nodeSpansDisjoint(const int *leaders, int numOfProcesses, int Mappers, int size, int *spanStart, int *spanEnd)
+{
+    // Function to work out every node's row span from the node leader of every rank
+    // Inputs:
+    // - leaders: world rank of the node leader of every rank
+    // - spanStart, spanEnd: receive the span of the node led by world rank L at index L
+    // Returns 1 if no mapper's rows fall inside the span of another node
+
+    for (int r = 0; r < numOfProcesses; r++)
+    {
+        spanStart[r] = size;
+        spanEnd[r] = 0;
+    }
+    for (int r = 1; r <= Mappers; r++)
+    {
+        int first = blockStart(r - 1, Mappers, size);
+        int end = first + blockLength(r - 1, Mappers, size);
+        if (end > first)
+        {
+            spanStart[leaders[r]] = first < spanStart[leaders[r]] ? first : spanStart[leaders[r]];
+            spanEnd[leaders[r]] = end > spanEnd[leaders[r]] ? end : spanEnd[leaders[r]];
+        }
+    }
+
+    for (int r = 1; r <= Mappers; r++)
+    {
+        int first = blockStart(r - 1, Mappers, size);
+        int end = first + blockLength(r - 1, Mappers, size);
+        for (int node = 0; node < numOfProcesses && end > first; node++)
+        {
+            if (node != leaders[r] && first < spanEnd[node] && spanStart[node] < end)
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+//--------------------------------------------------------------------//
+
+void readRowBlocksShared(int rank, int Mappers, int size, char *inputFile1, char *inputFile2, MapMode mapMode, MapperInput *input, NodeInput *node)
+{
+    // Function to give every mapper its rows through its node's shared window, called by all ranks
+    // Inputs:
+    // - rank: current process rank, mappers are ranks 1 .. Mappers
+    // - Mappers: total number of mappers, the rows are split between them with blockStart / blockLength
+    // - size: size of the matrix
+    // - inputFile1, inputFile2: the input files, visible to the first rank of every node
+    // - mapMode: MAP_OUTER shares columns of the first matrix instead of rows
+    // - input: receives views of the mapper's blocks, left empty on other ranks
+    // - node: receives the node communicator and window, released with freeNodeInput
+
+    int numOfProcesses;
+    MPI_Comm_size(MPI_COMM_WORLD, &numOfProcesses);
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node->nodeComm);
+    int nodeRank, nodeSize;
+    MPI_Comm_rank(node->nodeComm, &nodeRank);
+    MPI_Comm_size(node->nodeComm, &nodeSize);
+    // Ranks that can reach each other's memory, in world rank order
+
+    int leader = rank;
+    MPI_Bcast(&leader, 1, MPI_INT, 0, node->nodeComm);
+    int *leaders = (int *)malloc(numOfProcesses * sizeof(int));
+    MPI_Allgather(&leader, 1, MPI_INT, leaders, 1, MPI_INT, MPI_COMM_WORLD);
+    // Every rank learns the node of every other rank, so all of them reach the same decision below
+
+    int *spanStart = (int *)malloc(numOfProcesses * sizeof(int));
+    int *spanEnd = (int *)malloc(numOfProcesses * sizeof(int));
+    int disjoint = nodeSpansDisjoint(leaders, numOfProcesses, Mappers, size, spanStart, spanEnd);
+    node->spanStart = spanStart[leader];
+    node->spanRows = spanEnd[leader] > spanStart[leader] ? spanEnd[leader] - spanStart[leader] : 0;
+    free(leaders);
+    free(spanStart);
+    free(spanEnd);
+
+    if (!disjoint)
+    {
+        if (rank == 0)
+        {
+            printf("Ranks of a node do not hold adjacent rows, every mapper reads its own rows instead.\n");
+        }
+        MPI_Comm_free(&node->nodeComm);
+        node->window = MPI_WIN_NULL;
+        readRowBlocksCollective(rank, Mappers, size, inputFile1, inputFile2, mapMode, input);
+        return;
+    }
+
+    // -----------------------
+    // Shared Window
+    // -----------------------
+
+    int spanRows = node->spanRows;
+    int rowsA = mapMode == MAP_OUTER ? (spanRows > 0 ? size : 0) : spanRows;
+    int colsA = mapMode == MAP_OUTER ? spanRows : size;
+    int strideA = colsA > 0 ? (colsA + 15) / 16 * 16 : 16;
+    int strideB = (size + 15) / 16 * 16;
+    size_t cellsA = (size_t)rowsA * strideA;
+    size_t cellsB = (size_t)spanRows * strideB;
+    // Same row padding as allocateMatrix, so rows keep starting on a cache line
+
+    int *base;
+    MPI_Aint bytes = nodeRank == 0 ? (MPI_Aint)((cellsA + cellsB) * sizeof(int)) : 0;
+    MPI_Win_allocate_shared(bytes, sizeof(int), MPI_INFO_NULL, node->nodeComm, &base, &node->window);
+
+    MPI_Aint segment;
+    int unit;
+    MPI_Win_shared_query(node->window, 0, &segment, &unit, &base);
+    // Only the node's first rank allocates, every rank addresses its segment
+
+    Matrix *sharedA = sharedView(base, rowsA, colsA, strideA);
+    Matrix *sharedB = sharedView(base + cellsA, spanRows, size, strideB);
+
+    MPI_Win_fence(0, node->window);
+
+    MPI_Comm leaderComm;
+    MPI_Comm_split(MPI_COMM_WORLD, nodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &leaderComm);
+    if (nodeRank == 0)
+    {
+        Matrix *blockA = mapMode == MAP_OUTER ? readMatrixBlockCollective(leaderComm, inputFile1, size, 0, rowsA, node->spanStart, spanRows)
+                                              : readMatrixBlockCollective(leaderComm, inputFile1, size, node->spanStart, spanRows, 0, size);
+        Matrix *blockB = readMatrixBlockCollective(leaderComm, inputFile2, size, node->spanStart, spanRows, 0, size);
+        // The node spans are disjoint and cover every row, as the checksum check requires
+
+        for (int row = 0; row < rowsA; row++)
+        {
+            memcpy(MATRIX_ROW(sharedA, row), MATRIX_ROW(blockA, row), colsA * sizeof(int));
+        }
+        for (int row = 0; row < spanRows; row++)
+        {
+            memcpy(MATRIX_ROW(sharedB, row), MATRIX_ROW(blockB, row), size * sizeof(int));
+        }
+        freeMatrix(blockA);
+        freeMatrix(blockB);
+        MPI_Comm_free(&leaderComm);
+
+        char machineName[MPI_MAX_PROCESSOR_NAME];
+        int nameLength;
+        MPI_Get_processor_name(machineName, &nameLength);
+        printf("Process %d holds rows %d-%d for %d processes on %s in one shared copy (%.2f MB).\n", rank, node->spanStart,
+               node->spanStart + spanRows - 1, nodeSize, machineName, (cellsA + cellsB) * sizeof(int) / (1024.0 * 1024.0));
+    }
+
+    MPI_Win_fence(0, node->window);
+    // The first rank's stores are visible to the whole node from here on
+
+    // -----------------------
+    // Mapper Views
+    // -----------------------
+
+    int isMapper = rank >= 1 && rank <= Mappers;
+    input->firstRow = isMapper ? blockStart(rank - 1, Mappers, size) : 0;
+    input->rows = isMapper ? blockLength(rank - 1, Mappers, size) : 0;
+    input->blockA = NULL;
+    input->blockB = NULL;
+
+    if (isMapper)
+    {
+        int offset = input->firstRow - node->spanStart;
+        if (mapMode == MAP_OUTER)
+        {
+            input->blockA = sharedView(&MATRIX_AT(sharedA, 0, offset), size, input->rows, strideA);
+        }
+        else
+        {
+            input->blockA = sharedView(MATRIX_ROW(sharedA, offset), input->rows, size, strideA);
+        }
+        input->blockB = sharedView(MATRIX_ROW(sharedB, offset), input->rows, size, strideB);
+        // The mapper's blocks are windows onto the node's copy, nothing is copied
+    }
+
+    freeMatrix(sharedA);
+    freeMatrix(sharedB);
+}
+
+void freeNodeInput(NodeInput *node)
+{
+    if (node->window != MPI_WIN_NULL)
+    {
+        MPI_Win_free(&node->window);
+    }
+    if (node->nodeComm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&node->nodeComm);
+    }
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
@@ -0,0 +1,32 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef NODE_MEMORY_H
+#define NODE_MEMORY_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+typedef struct {
+    MPI_Comm nodeComm;      // ranks sharing this node's memory, MPI_COMM_NULL when not in use
+    MPI_Win window;         // the node's rows of A and B, allocated by the node's first rank
+    int spanStart;          // first row (column of A in outer product mode) held in the window
+    int spanRows;
+} NodeInput;
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+void readRowBlocksShared(int rank, int Mappers, int size, char* inputFile1, char* inputFile2, MapMode mapMode, MapperInput* input, NodeInput* node);
+void freeNodeInput(NodeInput* node);
+
+
+#endif
@@ -0,0 +1,144 @@
+#include "phase_timer.h"
+#include <mpi.h>
+
+//----------------------------------------------------------    Phase Timer    ----------------------------------------------------------//
+
+// Every rank keeps one clock per phase of the job. A rank is in exactly one phase at a time:
+// entering a phase stops the clock of the phase it was in, so a short wait inside a longer
+// phase (a mapper waiting for its next rows, say) is counted once, under the inner phase.
+// Only the main thread enters phases, worker threads compute inside them.
+
+static const char *phaseNames[PHASE_COUNT] = {"read", "dispatch", "map", "shuffle", "reduce", "gather", "write", "verify"};
+
+static double phaseSeconds[PHASE_COUNT];
+static Phase currentPhase = PHASE_NONE;
+static double phaseStart = 0.0;
+static double jobStart = 0.0;
+
+void startPhaseTimer(void)
+{
+    // Function to reset the clocks and start timing the job, called by all ranks
+    // The barrier lines the ranks up, so the job time is measured from one common start
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        phaseSeconds[p] = 0.0;
+    }
+    currentPhase = PHASE_NONE;
+    jobStart = MPI_Wtime();
+    phaseStart = jobStart;
+}
+
+Phase enterPhase(Phase phase)
+{
+    // Function to switch this rank to another phase
+    // Inputs:
+    // - phase: the phase the rank works in from now on, PHASE_NONE stops the clocks
+    // Returns the phase the rank was in, for the caller to go back to once it is done
+
+    double now = MPI_Wtime();
+    Phase previous = currentPhase;
+    if (previous != PHASE_NONE)
+    {
+        phaseSeconds[previous] += now - phaseStart;
+    }
+    currentPhase = phase;
+    phaseStart = now;
+    return previous;
+}
+
+//--------------------------------------------------------------------//
+
+static const char *engineName(EngineMode engine)
+{
+    return engine == ENGINE_SUMMA ? "summa" : engine == ENGINE_CANNON ? "cannon" : "mapreduce";
+}
+
+static const char *shuffleName(ShuffleMode shuffle)
+{
+    return shuffle == SHUFFLE_DIRECT ? "direct" : shuffle == SHUFFLE_STREAM ? "stream" : "master";
+}
+
+static const char *inputName(InputMode input)
+{
+    return input == INPUT_MASTER ? "master" : input == INPUT_SHARED ? "shared" : input == INPUT_RMA ? "rma" : "collective";
+}
+
+static void appendTimingRecord(const char *filename, int processes, int size, const JobOptions *options, double total, const double *seconds)
+{
+    // Function to append one CSV record of the job's phase times, with a header line if the file is new
+    // Inputs:
+    // - filename: file collecting the records of many runs
+    // - processes, size: process count and matrix size of the run
+    // - options: job options, the configuration columns of the record
+    // - total: wall time of the job
+    // - seconds: time of every phase on the slowest rank
+
+    FILE *file = fopen(filename, "a");
+    if (file == NULL)
+    {
+        printf("Error: Unable to open timings file %s\n", filename);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0)
+    {
+        fprintf(file, "engine,shuffle_mode,input_mode,map_mode,schedule,sparse,processes,threads,size,total");
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            fprintf(file, ",%s", phaseNames[p]);
+        }
+        fprintf(file, "\n");
+    }
+
+    fprintf(file, "%s,%s,%s,%s,%s,%d,%d,%d,%d,%.6f", engineName(options->engine), shuffleName(options->shuffle),
+            inputName(options->input), options->mapMode == MAP_OUTER ? "outer" : "row",
+            options->schedule == SCHEDULE_DYNAMIC ? "dynamic" : "static", options->sparse, processes, rankThreadCount(), size, total);
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        fprintf(file, ",%.6f", seconds[p]);
+    }
+    fprintf(file, "\n");
+    fclose(file);
+}
+
+void reportPhaseTimes(int rank, int size, const JobOptions *options)
+{
+    // Function to print the time of every phase on its slowest rank, called by all ranks at the end of the job
+    // Inputs:
+    // - rank: rank of the current process, the master prints
+    // - size: size of the matrices
+    // - options: job options, a timings file gets one CSV record of the run
+
+    enterPhase(PHASE_NONE);
+    MPI_Barrier(MPI_COMM_WORLD);
+    double total = MPI_Wtime() - jobStart;
+    // The job ends when its last rank is done
+
+    double slowest[PHASE_COUNT];
+    MPI_Reduce(phaseSeconds, slowest, PHASE_COUNT, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    // Phases overlap across ranks, the slowest rank of each phase is the one that holds the job up
+
+    if (rank == 0)
+    {
+        int processes;
+        MPI_Comm_size(MPI_COMM_WORLD, &processes);
+
+        printf("\nPhase times (slowest process):");
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            printf(" %s %.4f s%s", phaseNames[p], slowest[p], p + 1 < PHASE_COUNT ? "," : "");
+        }
+        printf("\nJob time: %.4f seconds on %d processes\n", total, processes);
+
+        if (options->timingsFile != NULL)
+        {
+            appendTimingRecord(options->timingsFile, processes, size, options, total, slowest);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
@@ -0,0 +1,39 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+typedef enum {
+    PHASE_NONE = -1,        // setup and anything not attributed to a phase
+    PHASE_READ,             // reading the input files, or fetching rows from the master's windows
+    PHASE_DISPATCH,         // the master sending out input rows, mappers waiting for theirs
+    PHASE_MAP,              // mappers producing and emitting pairs, local block products in SUMMA and Cannon
+    PHASE_SHUFFLE,          // moving pairs to the reducers and grouping them by key, panel and tile exchanges
+    PHASE_REDUCE,           // reducing the values of every output cell
+    PHASE_GATHER,           // bringing the result cells to the master
+    PHASE_WRITE,            // writing the output file
+    PHASE_VERIFY,           // comparing the output with the serial product
+    PHASE_COUNT
+} Phase;
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+void startPhaseTimer(void);
+Phase enterPhase(Phase phase);
+void reportPhaseTimes(int rank, int size, const JobOptions* options);
+
+
+#endif
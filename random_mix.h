@@ -0,0 +1,34 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include <stdint.h>
+
+
+#ifndef RANDOM_MIX_H
+#define RANDOM_MIX_H
+
+
+// ---------------------------------
+// Counter-Based Generator
+// ---------------------------------
+
+// SplitMix64: element n of a stream keyed by 'key' is mix64(key + GOLDEN_GAMMA * (n + 1)).
+// The input generator draws its matrices this way and the Freivalds check its random vectors.
+
+#define GOLDEN_GAMMA 0x9e3779b97f4a7c15ULL
+
+static inline uint64_t mix64(uint64_t x)
+{
+    // SplitMix64 finaliser, every input bit affects every output bit
+
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+#endif
@@ -0,0 +1,59 @@
+#include "matrix_operations.h"
+#include "gemm_kernel.h"
+
+// Checks that a reducer computes a cell from well-formed values and rejects malformed ones:
+// values missing, an inner index given twice for the same matrix (also right after a complete
+// pair), or an inner index out of range. Covers the dense and the sparse join of reduceKeyValues.
+// Prints every failed case and exits with a nonzero status if there is one.
+//
+// Usage: reduce_check
+
+typedef struct {
+    const char *name;
+    int sparse;
+    int count;
+    MatrixValue values[8];
+    int status;                 // expected return value of reduceKeyValues
+    int result;                 // expected cell, when status is 0
+} ReduceCase;
+
+#define SIZE 4
+
+static const ReduceCase cases[] = {
+    {"dense, all values", 0, 8, {{'1', 0, 1}, {'2', 0, 2}, {'1', 1, 3}, {'2', 1, 4}, {'1', 2, 5}, {'2', 2, 6}, {'1', 3, 7}, {'2', 3, 8}}, 0, 100},
+    {"dense, index twice", 0, 8, {{'1', 0, 1}, {'2', 0, 2}, {'1', 1, 3}, {'2', 1, 4}, {'1', 1, 5}, {'2', 2, 6}, {'1', 3, 7}, {'2', 3, 8}}, -1, 0},
+    {"dense, value missing", 0, 7, {{'1', 0, 1}, {'2', 0, 2}, {'1', 1, 3}, {'2', 1, 4}, {'1', 2, 5}, {'2', 2, 6}, {'1', 3, 7}}, -1, 0},
+    {"dense, index out of range", 0, 8, {{'1', 0, 1}, {'2', 0, 2}, {'1', 1, 3}, {'2', 1, 4}, {'1', 2, 5}, {'2', 2, 6}, {'1', 4, 7}, {'2', 3, 8}}, -1, 0},
+    {"sparse, pairs and lone values", 1, 5, {{'2', 3, 5}, {'1', 0, 9}, {'1', 3, 2}, {'2', 1, 7}, {'2', 2, 1}}, 0, 10},
+    {"sparse, no values", 1, 0, {{0, 0, 0}}, 0, 0},
+    {"sparse, B twice after a pair", 1, 3, {{'1', 2, 3}, {'2', 2, 4}, {'2', 2, 5}}, -1, 0},
+    {"sparse, A twice before a pair", 1, 3, {{'1', 2, 3}, {'1', 2, 4}, {'2', 2, 5}}, -1, 0},
+    {"sparse, lone value twice", 1, 2, {{'2', 1, 3}, {'2', 1, 3}}, -1, 0},
+    {"sparse, index out of range", 1, 2, {{'1', SIZE, 3}, {'2', SIZE, 4}}, -1, 0},
+    {"sparse, unknown matrix", 1, 2, {{'1', 0, 3}, {'3', 0, 4}}, -1, 0},
+};
+
+int main(void)
+{
+    selectGemmKernel();   // the dot product the job itself uses
+
+    char *scratch = (char *)malloc(REDUCE_SCRATCH_BYTES(SIZE));
+    int failures = 0;
+    int total = sizeof(cases) / sizeof(cases[0]);
+
+    for (int c = 0; c < total; c++)
+    {
+        int result = 0;
+        int status = reduceKeyValues(cases[c].values, cases[c].count, SIZE, cases[c].sparse, scratch, &result);
+        if (status != cases[c].status || (status == 0 && result != cases[c].result))
+        {
+            printf("FAILED: %s: returned %d with cell %d, expected %d with cell %d\n", cases[c].name, status, result,
+                   cases[c].status, cases[c].result);
+            failures++;
+        }
+    }
+
+    free(scratch);
+    printf("%d of %d reduce cases passed\n", total - failures, total);
+    return failures > 0 ? 1 : 0;
+}
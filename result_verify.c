@@ -0,0 +1,214 @@
+#include "result_verify.h"
+#include "phase_timer.h"
+#include "random_mix.h"
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//----------------------------------------------------------    Result Verification    ----------------------------------------------------------//
+
+// Freivalds' check: for a random vector r, A * (B * r) equals C * r whenever C = A * B, and
+// differs with probability at least one half otherwise. Each round costs two matrix-vector
+// products instead of a whole matrix product, so the check is O(size^2) per round.
+// All arithmetic is on uint32_t and wraps, like the int arithmetic of the job itself, so the
+// check is exact modulo 2^32. An error is then missed by one round with probability at most
+// 1/2 (only for differences divisible by 2^31), and far less for almost any other error.
+// The check runs where the data already is: every rank passes the pieces of A, B and C it
+// still holds, each element held by exactly one rank, and the partial products are summed
+// with two reductions of size * rounds values. The vectors come from the SplitMix64 hash in random_mix.h.
+
+MatrixPiece matrixPiece(int rowStart, int rows, int colStart, int cols, const int *data, int ld)
+{
+    // Function to describe a block of a matrix held in memory, empty when either extent is not positive
+
+    MatrixPiece piece = {rowStart, rows, colStart, cols, data, ld};
+    if (rows <= 0 || cols <= 0)
+    {
+        piece.rows = 0;
+        piece.cols = 0;
+    }
+    return piece;
+}
+
+int cellRangePieces(int firstKey, int numKeys, const int *values, int size, MatrixPiece *pieces)
+{
+    // Function to describe a run of output cells i * size + k as blocks
+    // Inputs:
+    // - firstKey, numKeys, values: the run, in row-major order
+    // - pieces: receives at most MAX_RESULT_PIECES blocks
+    // Returns the number of blocks
+
+    int count = 0;
+    int key = firstKey;
+    int end = firstKey + numKeys;
+    const int *cursor = values;
+
+    if (key < end && key % size != 0)
+    {
+        int cols = size - key % size < end - key ? size - key % size : end - key;
+        pieces[count++] = matrixPiece(key / size, 1, key % size, cols, cursor, size);
+        key += cols;
+        cursor += cols;
+    }
+    // The tail of the first row when the run starts inside it
+
+    int rows = (end - key) / size;
+    if (rows > 0)
+    {
+        pieces[count++] = matrixPiece(key / size, rows, 0, size, cursor, size);
+        key += rows * size;
+        cursor += (size_t)rows * size;
+    }
+
+    if (key < end)
+    {
+        pieces[count++] = matrixPiece(key / size, 1, 0, end - key, cursor, size);
+    }
+    // The head of the last row when the run stops inside it
+
+    return count;
+}
+
+int mapperInputPieces(const MapperInput *input, int size, MapMode mapMode, MatrixPiece *pieceA, MatrixPiece *pieceB)
+{
+    // Function to describe the rows of A and B a mapper was given, kept until the check
+    // Returns the number of pieces of each matrix, 0 for ranks that did not map
+
+    if (input->rows == 0 || input->blockA == NULL)
+    {
+        return 0;
+    }
+
+    if (mapMode == MAP_OUTER)
+    {
+        *pieceA = matrixPiece(0, size, input->firstRow, input->rows, input->blockA->data, input->blockA->stride);
+    }
+    else
+    {
+        *pieceA = matrixPiece(input->firstRow, input->rows, 0, size, input->blockA->data, input->blockA->stride);
+    }
+    *pieceB = matrixPiece(input->firstRow, input->rows, 0, size, input->blockB->data, input->blockB->stride);
+    return 1;
+}
+
+//--------------------------------------------------------------------//
+
+static void accumulatePieces(const MatrixPiece *pieces, int count, int rounds, const uint32_t *vectors, uint32_t *result, uint32_t sign)
+{
+    // Function to add sign * piece * vectors to result for every piece
+    // Inputs:
+    // - rounds: vectors per row, vectors and result hold element j of every vector at j * rounds
+    // - sign: 1 to add the product, (uint32_t)-1 to subtract it
+
+    for (int p = 0; p < count; p++)
+    {
+        const MatrixPiece *piece = &pieces[p];
+
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < piece->rows; r++)
+        {
+            const int *row = piece->data + (size_t)r * piece->ld;
+            uint32_t *out = &result[(size_t)(piece->rowStart + r) * rounds];
+            // Every thread owns whole rows of the result
+
+            for (int c = 0; c < piece->cols; c++)
+            {
+                uint32_t value = sign * (uint32_t)row[c];
+                if (value == 0)
+                {
+                    continue;   // zeros of sparse inputs cost nothing
+                }
+                const uint32_t *vector = &vectors[(size_t)(piece->colStart + c) * rounds];
+                for (int t = 0; t < rounds; t++)
+                {
+                    out[t] += value * vector[t];
+                }
+            }
+        }
+    }
+}
+
+bool freivaldsCheck(int size, int rounds, const MatrixPiece *piecesA, int countA, const MatrixPiece *piecesB, int countB,
+                    const MatrixPiece *piecesC, int countC)
+{
+    // Function to check C = A * B with 'rounds' random vectors at once, called by all ranks
+    // Inputs:
+    // - size: size of the matrices
+    // - rounds: number of random vectors
+    // - piecesA, piecesB, piecesC: the blocks of each matrix this rank holds, none for ranks holding nothing
+    // Returns true on every rank when A * (B * r) = C * r for every vector
+
+    uint64_t seed = 0;
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0)
+    {
+        seed = mix64((uint64_t)time(NULL) ^ ((uint64_t)(MPI_Wtime() * 1e9) << 16));
+    }
+    MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    // A fresh seed per run, the same vectors on every rank
+
+    size_t length = (size_t)size * rounds;
+    uint32_t *vectors = (uint32_t *)calloc(length + 1, sizeof(uint32_t));
+    uint32_t *products = (uint32_t *)calloc(length + 1, sizeof(uint32_t));
+    uint32_t *differences = (uint32_t *)calloc(length + 1, sizeof(uint32_t));
+
+    for (size_t e = 0; e < length; e++)
+    {
+        vectors[e] = (uint32_t)(mix64(seed + GOLDEN_GAMMA * (e + 1)) >> 32);
+    }
+
+    accumulatePieces(piecesB, countB, rounds, vectors, products, 1);
+    MPI_Allreduce(MPI_IN_PLACE, products, (int)length, MPI_UINT32_T, MPI_SUM, MPI_COMM_WORLD);
+    // B * r, complete on every rank
+
+    accumulatePieces(piecesA, countA, rounds, products, differences, 1);
+    accumulatePieces(piecesC, countC, rounds, vectors, differences, (uint32_t)-1);
+    MPI_Allreduce(MPI_IN_PLACE, differences, (int)length, MPI_UINT32_T, MPI_SUM, MPI_COMM_WORLD);
+    // A * (B * r) - C * r, zero everywhere when the product is right
+
+    bool equal = true;
+    for (size_t e = 0; e < length && equal; e++)
+    {
+        equal = differences[e] == 0;
+    }
+
+    free(vectors);
+    free(products);
+    free(differences);
+    return equal;
+}
+
+void verifyJobResult(int rank, char *File1, char *File2, int size, const JobOptions *options, const MatrixPiece *piecesA, int countA,
+                     const MatrixPiece *piecesB, int countB, const MatrixPiece *piecesC, int countC)
+{
+    // Function to check the result of the job and print the outcome on the master, called by all ranks once the output is written
+    // Inputs:
+    // - rank: rank of the current process
+    // - File1, File2: the input files, only read by the exact comparison
+    // - size: size of the matrices
+    // - options: job options, the verification mode and number of rounds
+    // - piecesA, piecesB, piecesC: the blocks of the input and the result this rank holds
+
+    if (options->verify == VERIFY_EXACT)
+    {
+        if (rank == 0)
+        {
+            printMatrixComparison(File1, File2, outputFileName(options), size);
+            // Re-read the files and recompute the whole product on the master
+        }
+        return;
+    }
+
+    Phase previous = enterPhase(PHASE_VERIFY);
+    bool equal = freivaldsCheck(size, options->verifyRounds, piecesA, countA, piecesB, countB, piecesC, countC);
+    if (rank == 0)
+    {
+        printf("\nFreivalds Check (%d rounds) Returned: %s\n", options->verifyRounds, equal ? "True" : "False");
+    }
+    enterPhase(previous);
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
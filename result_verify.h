@@ -0,0 +1,41 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef RESULT_VERIFY_H
+#define RESULT_VERIFY_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+typedef struct {
+    int rowStart;           // matrix row of the block's first row
+    int rows;
+    int colStart;           // matrix column of the block's first column
+    int cols;
+    const int* data;        // row-major elements of the block
+    int ld;                 // ints from one row of the block to the next
+} MatrixPiece;
+
+#define MAX_RESULT_PIECES 3   // a run of output cells covers a partial row, whole rows and a partial row
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+MatrixPiece matrixPiece(int rowStart, int rows, int colStart, int cols, const int* data, int ld);
+int mapperInputPieces(const MapperInput* input, int size, MapMode mapMode, MatrixPiece* pieceA, MatrixPiece* pieceB);
+int cellRangePieces(int firstKey, int numKeys, const int* values, int size, MatrixPiece* pieces);
+bool freivaldsCheck(int size, int rounds, const MatrixPiece* piecesA, int countA, const MatrixPiece* piecesB, int countB,
+                    const MatrixPiece* piecesC, int countC);
+void verifyJobResult(int rank, char* File1, char* File2, int size, const JobOptions* options, const MatrixPiece* piecesA, int countA,
+                     const MatrixPiece* piecesB, int countB, const MatrixPiece* piecesC, int countC);
+
+
+#endif
@@ -0,0 +1,180 @@
+#include "rma_input.h"
+#include "phase_timer.h"
+
+//----------------------------------------------------------    One-Sided Input    ----------------------------------------------------------//
+
+// The master reads A and B and exposes them as RMA windows instead of sending them out. Each
+// mapper fetches its own rows with MPI_Rget under a shared passive-target lock, so the master
+// takes no part in the transfer and never waits for a slow receiver. The rows arrive two groups
+// at a time: while a group is mapped the next one is already on its way.
+
+void exposeInputMatrices(int rank, const Matrix *matrix1, const Matrix *matrix2, RmaInput *rma)
+{
+    // Function to expose the master's matrices as RMA windows, called by all ranks
+    // Inputs:
+    // - rank: current process rank, rank 0 holds the matrices
+    // - matrix1, matrix2: the input matrices on rank 0, ignored elsewhere
+    // - rma: receives the windows and the strides of the master's rows
+
+    int strides[2] = {0, 0};
+    if (rank == 0)
+    {
+        MPI_Win_create(matrix1->data, (MPI_Aint)matrix1->rows * matrix1->stride * sizeof(int), sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &rma->windowA);
+        MPI_Win_create(matrix2->data, (MPI_Aint)matrix2->rows * matrix2->stride * sizeof(int), sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &rma->windowB);
+        strides[0] = matrix1->stride;
+        strides[1] = matrix2->stride;
+    }
+    else
+    {
+        MPI_Win_create(NULL, 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &rma->windowA);
+        MPI_Win_create(NULL, 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &rma->windowB);
+    }
+    // Window creation is collective, the other ranks expose nothing
+
+    MPI_Bcast(strides, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    rma->strideA = strides[0];
+    rma->strideB = strides[1];
+    // Padded or mapped rows, the fetching ranks need the master's layout to address them
+}
+
+static void requestRowGroup(MapperInput *input)
+{
+    // Function to start the gets of the next group of rows of a block
+
+    RowFetch *fetch = input->fetch;
+    int start = fetch->requested;
+    int count = input->rows - start < fetch->groupRows ? input->rows - start : fetch->groupRows;
+    MPI_Request *requests = &fetch->requests[2 * ((start / fetch->groupRows) % 2)];
+    int first = input->firstRow + start;
+
+    MPI_Datatype originA, targetA;
+    MPI_Aint displacementA;
+    int *destinationA;
+    if (fetch->mapMode == MAP_OUTER)
+    {
+        originA = createMatrixBlockType(input->blockA, fetch->size, count);
+        MPI_Type_vector(fetch->size, count, fetch->rma->strideA, MPI_INT, &targetA);
+        displacementA = first;
+        destinationA = &MATRIX_AT(input->blockA, 0, start);
+        // Columns first .. first + count of A, down all of its rows
+    }
+    else
+    {
+        originA = createMatrixBlockType(input->blockA, count, fetch->size);
+        MPI_Type_vector(count, fetch->size, fetch->rma->strideA, MPI_INT, &targetA);
+        displacementA = (MPI_Aint)first * fetch->rma->strideA;
+        destinationA = MATRIX_ROW(input->blockA, start);
+    }
+    MPI_Type_commit(&targetA);
+
+    MPI_Datatype originB = createMatrixBlockType(input->blockB, count, fetch->size);
+    MPI_Datatype targetB;
+    MPI_Type_vector(count, fetch->size, fetch->rma->strideB, MPI_INT, &targetB);
+    MPI_Type_commit(&targetB);
+
+    MPI_Rget(destinationA, 1, originA, 0, displacementA, 1, targetA, fetch->rma->windowA, &requests[0]);
+    MPI_Rget(MATRIX_ROW(input->blockB, start), 1, originB, 0, (MPI_Aint)first * fetch->rma->strideB, 1, targetB, fetch->rma->windowB, &requests[1]);
+    // Straight into the mapper's blocks, in the layout of both sides
+
+    MPI_Type_free(&originA);
+    MPI_Type_free(&targetA);
+    MPI_Type_free(&originB);
+    MPI_Type_free(&targetB);
+    // Freeing only marks the types, the pending gets keep them alive
+
+    fetch->requested += count;
+}
+
+void fetchRowsRma(const RmaInput *rma, int size, MapMode mapMode, int firstRow, int rows, int groupRows, MapperInput *input)
+{
+    // Function to start fetching a block of rows from the master's windows
+    // Inputs:
+    // - rma: the master's windows
+    // - size: size of the matrix
+    // - mapMode: MAP_OUTER fetches the size x rows block of columns of A, in one piece
+    // - firstRow, rows: the rows to fetch
+    // - groupRows: rows per get, the group size the rows are mapped in
+    // - input: receives the blocks, which fill in the background; awaitRows waits for them
+
+    input->firstRow = firstRow;
+    input->rows = rows;
+    input->blockA = mapMode == MAP_OUTER ? allocateMatrix(size, rows) : allocateMatrix(rows, size);
+    input->blockB = allocateMatrix(rows, size);
+    input->fetch = NULL;
+
+    if (rows == 0)
+    {
+        return;
+    }
+
+    RowFetch *fetch = (RowFetch *)malloc(sizeof(RowFetch));
+    fetch->rma = rma;
+    fetch->size = size;
+    fetch->mapMode = mapMode;
+    fetch->groupRows = mapMode == MAP_OUTER || groupRows < 1 ? rows : groupRows;
+    fetch->requested = 0;
+    fetch->arrived = 0;
+    for (int r = 0; r < RMA_FETCH_REQUESTS; r++)
+    {
+        fetch->requests[r] = MPI_REQUEST_NULL;
+    }
+    input->fetch = fetch;
+
+    MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, rma->windowA);
+    MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, rma->windowB);
+    // Passive target: the master is never involved, any number of mappers read at once
+
+    for (int buffer = 0; buffer < 2 && fetch->requested < rows; buffer++)
+    {
+        requestRowGroup(input);
+    }
+}
+
+void awaitRows(MapperInput *input, int rows)
+{
+    // Function to wait until the first 'rows' rows of a mapper's blocks are in memory
+    // Inputs:
+    // - input: the mapper's blocks, returns at once when they were not fetched with fetchRowsRma
+    // - rows: rows of the blocks the caller is about to use
+
+    RowFetch *fetch = input->fetch;
+    if (fetch == NULL)
+    {
+        return;
+    }
+
+    Phase previous = enterPhase(PHASE_READ);
+    while (fetch->arrived < rows)
+    {
+        int start = fetch->arrived;
+        MPI_Waitall(2, &fetch->requests[2 * ((start / fetch->groupRows) % 2)], MPI_STATUSES_IGNORE);
+        fetch->arrived += input->rows - start < fetch->groupRows ? input->rows - start : fetch->groupRows;
+
+        if (fetch->requested < input->rows)
+        {
+            requestRowGroup(input);
+        }
+        // Keep two groups in flight, the next one arrives while this one is mapped
+    }
+
+    if (fetch->arrived == input->rows)
+    {
+        MPI_Win_unlock(0, fetch->rma->windowA);
+        MPI_Win_unlock(0, fetch->rma->windowB);
+        free(fetch);
+        input->fetch = NULL;
+    }
+    enterPhase(previous);
+}
+
+void freeRmaInput(RmaInput *rma)
+{
+    if (rma->windowA != MPI_WIN_NULL)
+    {
+        MPI_Win_free(&rma->windowA);
+        MPI_Win_free(&rma->windowB);
+    }
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
@@ -0,0 +1,46 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef RMA_INPUT_H
+#define RMA_INPUT_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+#define RMA_FETCH_REQUESTS 4        // two groups of rows in flight, one get per matrix each
+
+typedef struct {
+    MPI_Win windowA;        // the master's copy of A, MPI_WIN_NULL when not in use
+    MPI_Win windowB;        // the master's copy of B
+    int strideA;            // row strides of the master's matrices, displacements are counted in ints
+    int strideB;
+} RmaInput;
+
+struct RowFetch {
+    const RmaInput* rma;
+    int size;
+    MapMode mapMode;
+    int groupRows;          // rows per get, the whole block in outer product mode
+    int requested;          // rows of the block asked for so far
+    int arrived;            // rows of the block that are in memory
+    MPI_Request requests[RMA_FETCH_REQUESTS];
+};
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+void exposeInputMatrices(int rank, const Matrix* matrix1, const Matrix* matrix2, RmaInput* rma);
+void fetchRowsRma(const RmaInput* rma, int size, MapMode mapMode, int firstRow, int rows, int groupRows, MapperInput* input);
+void awaitRows(MapperInput* input, int rows);
+void freeRmaInput(RmaInput* rma);
+
+
+#endif
@@ -0,0 +1,600 @@
+#include "stream_pipeline.h"
+#include "rma_input.h"
+#include "gemm_kernel.h"
+#include "phase_timer.h"
+
+#define STREAM_PAIR_TAG 60
+#define STREAM_PAIR_BYTES (sizeof(MatrixKey) + sizeof(MatrixValue))
+
+//----------------------------------------------------------    Streaming Shuffle    ----------------------------------------------------------//
+
+// Runs map, shuffle and reduce as one pipeline without any barrier or collective between them.
+// Mappers send every full batch of pairs straight to the reducer that owns its keys with a
+// nonblocking send, keeping at most 'window' sends in flight. Reducers keep 'window' receives
+// posted and reduce a key the moment its last value arrives. When the master distributes the
+// input, the rows arrive a group at a time and the next group is received while the current
+// one is mapped. Communication thus overlaps computation instead of following it.
+// Sparse mappers leave out zero elements, so a reducer cannot tell from the count when a key is
+// complete. Every mapper then closes with a message to every reducer saying how many pairs it
+// sent there; keys still short of values once all of those have arrived are reduced from what
+// is there.
+
+// Returns whether the mappers receive their rows group by group from the master. Outer product
+// mappers combine their whole block in one product, so they receive it whole.
+
+int streamsInputRows(const JobOptions *options)
+{
+    return options->shuffle == SHUFFLE_STREAM && options->input == INPUT_MASTER && options->mapMode == MAP_ROW;
+}
+
+void streamRowsToMappers(int Mappers, int size, const Matrix *matrix1, const Matrix *matrix2, int groupRows, int window)
+{
+    // Function to send every mapper its rows one group at a time
+    // Inputs:
+    // - Mappers: total number of mappers, the rows are split between them with blockStart / blockLength
+    // - size: size of the matrix
+    // - matrix1, matrix2: the input matrices
+    // - groupRows: rows per message, the group a mapper maps at once
+    // - window: groups kept in flight, each one message per matrix
+
+    int *headers = (int *)malloc(3 * Mappers * sizeof(int));
+    MPI_Request *headerRequests = (MPI_Request *)malloc(Mappers * sizeof(MPI_Request));
+
+    for (int i = 1; i < Mappers + 1; i++)
+    {
+        int *header = &headers[3 * (i - 1)];
+        header[0] = blockStart(i - 1, Mappers, size);
+        header[1] = blockLength(i - 1, Mappers, size);
+        header[2] = groupRows;
+        // First row of the block, the number of rows in it and the rows per message
+
+        MPI_Isend(header, 3, MPI_INT, i, 1, MPI_COMM_WORLD, &headerRequests[i - 1]);
+        printf("Task Map Assigned to process %d.\n", i);
+    }
+
+    int slots = 2 * window;
+    MPI_Request *requests = (MPI_Request *)malloc(slots * sizeof(MPI_Request));
+    for (int s = 0; s < slots; s++)
+    {
+        requests[s] = MPI_REQUEST_NULL;
+    }
+
+    int maxRows = blockLength(0, Mappers, size);
+    for (int start = 0; start < maxRows; start += groupRows)
+    {
+        // Group by group across all mappers, so every mapper can start on its first rows early
+
+        for (int i = 1; i < Mappers + 1; i++)
+        {
+            int rows = blockLength(i - 1, Mappers, size);
+            int count = rows - start < groupRows ? rows - start : groupRows;
+            if (count <= 0)
+            {
+                continue;
+            }
+            // Mappers with one row less may already have all of theirs
+
+            int row = blockStart(i - 1, Mappers, size) + start;
+            MPI_Datatype typeA = createMatrixBlockType(matrix1, count, size);
+            MPI_Datatype typeB = createMatrixBlockType(matrix2, count, size);
+
+            int slot = 0;
+            while (slot < slots && requests[slot] != MPI_REQUEST_NULL)
+            {
+                slot++;
+            }
+            if (slot == slots)
+            {
+                MPI_Waitany(slots, requests, &slot, MPI_STATUS_IGNORE);
+            }
+            MPI_Isend(MATRIX_ROW(matrix1, row), 1, typeA, i, 2, MPI_COMM_WORLD, &requests[slot]);
+            // A group of rows of matrix1 (tag 2)
+
+            slot = 0;
+            while (slot < slots && requests[slot] != MPI_REQUEST_NULL)
+            {
+                slot++;
+            }
+            if (slot == slots)
+            {
+                MPI_Waitany(slots, requests, &slot, MPI_STATUS_IGNORE);
+            }
+            MPI_Isend(MATRIX_ROW(matrix2, row), 1, typeB, i, 3, MPI_COMM_WORLD, &requests[slot]);
+            // The same rows of matrix2 (tag 3)
+
+            MPI_Type_free(&typeA);
+            MPI_Type_free(&typeB);
+        }
+    }
+
+    MPI_Waitall(slots, requests, MPI_STATUSES_IGNORE);
+    MPI_Waitall(Mappers, headerRequests, MPI_STATUSES_IGNORE);
+
+    free(requests);
+    free(headerRequests);
+    free(headers);
+}
+
+//--------------------------------------------------------------------//
+
+static int stillReceiving(const StreamState *stream)
+{
+    return stream->pendingPairs > 0 || (stream->sparse && stream->pendingMappers > 0);
+}
+
+static void reportFaultyCell(int i, int k)
+{
+    // Function to stop the job on a cell with a value out of range or received twice, like the other reducers do
+
+    printf("Error: Output cell (%d, %d) has missing or duplicate values\n", i, k);
+    MPI_Abort(MPI_COMM_WORLD, 1);   // mappers may still be sending to this rank, exiting alone would leave them blocked
+}
+
+static void consumePairs(StreamState *stream, const char *buffer, int bytes)
+{
+    // Function to add a received batch of pairs to the keys they belong to
+    // Keys whose last value arrives here are reduced right away, a value out of range or received twice stops the job
+
+    if (bytes == sizeof(long long))
+    {
+        long long announced;
+        memcpy(&announced, buffer, sizeof(announced));
+        stream->pendingPairs += announced;
+        stream->pendingMappers--;
+        return;
+        // A sparse mapper's closing message, shorter than any pair
+    }
+
+    int count = bytes / STREAM_PAIR_BYTES;
+    const MatrixKey *keys = (const MatrixKey *)buffer;
+    const MatrixValue *values = (const MatrixValue *)(buffer + count * sizeof(MatrixKey));
+    ReducerOutput *output = stream->output;
+    int size = stream->size;
+
+    for (int p = 0; p < count; p++)
+    {
+        int q = keys[p].i * size + keys[p].k - output->firstKey;
+        if (keys[p].i < 0 || keys[p].i >= size || keys[p].k < 0 || keys[p].k >= size || q < 0 || q >= output->numKeys)
+        {
+            reportFaultyCell(keys[p].i, keys[p].k);
+        }
+
+        if (values[p].mat == 'P')
+        {
+            output->values[q] += values[p].val;
+            // Outer product mode: partial sums are simply added up
+        }
+        else
+        {
+            int side = values[p].mat == '1' ? 0 : values[p].mat == '2' ? 1 : -1;
+            size_t slot = (size_t)q * size + values[p].j;
+            if (side < 0 || values[p].j < 0 || values[p].j >= size || stream->present[2 * slot + side])
+            {
+                reportFaultyCell(keys[p].i, keys[p].k);
+            }
+            stream->present[2 * slot + side] = 1;
+            // One byte per value of the key, so a duplicate cannot stand in for a missing value
+
+            if (side == 0)
+            {
+                stream->rowValues[slot] = values[p].val;
+            }
+            else
+            {
+                stream->columnValues[slot] = values[p].val;
+            }
+        }
+
+        stream->arrived[q]++;
+        if (stream->arrived[q] > stream->valuesPerKey)
+        {
+            reportFaultyCell(keys[p].i, keys[p].k);
+        }
+        if (stream->arrived[q] == stream->valuesPerKey && values[p].mat != 'P')
+        {
+            output->values[q] = dotProduct(size, &stream->rowValues[(size_t)q * size], &stream->columnValues[(size_t)q * size]);
+            // All 2 * size values of the key are in, reduce it now
+        }
+    }
+
+    stream->pendingPairs -= count;
+}
+
+static void postPairReceive(StreamState *stream, int slot)
+{
+    MPI_Irecv(stream->receiveBuffers[slot], stream->batchSize * STREAM_PAIR_BYTES, MPI_BYTE, MPI_ANY_SOURCE,
+              STREAM_PAIR_TAG, MPI_COMM_WORLD, &stream->requests[slot]);
+}
+
+static void streamProgress(StreamState *stream, int wait)
+{
+    // Function to complete whatever communication is ready
+    // Inputs:
+    // - stream: the rank's streaming state
+    // - wait: block until at least one request completes, otherwise only test
+
+    int total = 2 * stream->window + STREAM_INPUT_REQUESTS;
+    int done = 0;
+
+    if (wait)
+    {
+        double start = MPI_Wtime();
+        MPI_Waitsome(total, stream->requests, &done, stream->completed, stream->statuses);
+        stream->waitTime += MPI_Wtime() - start;
+    }
+    else
+    {
+        MPI_Testsome(total, stream->requests, &done, stream->completed, stream->statuses);
+    }
+
+    for (int c = 0; c < done && done != MPI_UNDEFINED; c++)
+    {
+        int slot = stream->completed[c];
+        if (slot < stream->window)
+        {
+            int bytes = 0;
+            MPI_Get_count(&stream->statuses[c], MPI_BYTE, &bytes);
+            consumePairs(stream, stream->receiveBuffers[slot], bytes);
+            if (stillReceiving(stream))
+            {
+                postPairReceive(stream, slot);
+            }
+        }
+        // Finished sends and row groups only free their slot, which MPI already did
+    }
+}
+
+static int freeSendSlot(StreamState *stream)
+{
+    int slot = -1;
+    while (slot < 0)
+    {
+        for (int s = 0; s < stream->window && slot < 0; s++)
+        {
+            if (stream->requests[stream->window + s] == MPI_REQUEST_NULL)
+            {
+                slot = s;
+            }
+        }
+        if (slot < 0)
+        {
+            Phase previous = enterPhase(PHASE_SHUFFLE);
+            streamProgress(stream, 1);
+            enterPhase(previous);
+        }
+    }
+    // Wait for a free send slot, receiving meanwhile so the other ranks' sends can finish too
+    return slot;
+}
+
+static void sendPartition(StreamState *stream, int reducer)
+{
+    // Function to send the pairs collected for one reducer as one message
+
+    PairBatch *partition = &stream->partitions[reducer];
+    if (partition->count == 0)
+    {
+        return;
+    }
+
+    int slot = freeSendSlot(stream);
+    char *buffer = stream->sendBuffers[slot];
+    memcpy(buffer, partition->keys, partition->count * sizeof(MatrixKey));
+    memcpy(buffer + partition->count * sizeof(MatrixKey), partition->values, partition->count * sizeof(MatrixValue));
+
+    MPI_Isend(buffer, partition->count * STREAM_PAIR_BYTES, MPI_BYTE, stream->reducerRanks[reducer],
+              STREAM_PAIR_TAG, MPI_COMM_WORLD, &stream->requests[stream->window + slot]);
+    stream->messagesSent++;
+    if (stream->sparse)
+    {
+        stream->pairsSent[reducer] += partition->count;
+    }
+    partition->count = 0;
+}
+
+static void sendClosing(StreamState *stream, int reducer)
+{
+    // Function to tell a reducer how many pairs this sparse mapper sent it in all
+
+    int slot = freeSendSlot(stream);
+    memcpy(stream->sendBuffers[slot], &stream->pairsSent[reducer], sizeof(long long));
+    MPI_Isend(stream->sendBuffers[slot], sizeof(long long), MPI_BYTE, stream->reducerRanks[reducer],
+              STREAM_PAIR_TAG, MPI_COMM_WORLD, &stream->requests[stream->window + slot]);
+    stream->messagesSent++;
+}
+
+static void emitToStream(void *context, const MatrixKey *key, const MatrixValue *value)
+{
+    StreamState *stream = (StreamState *)context;
+    int reducer = reducerForKey(key->i * stream->size + key->k, stream->Reducers, stream->size);
+    appendPair(&stream->partitions[reducer], key, value);
+    if (stream->partitions[reducer].count == stream->batchSize)
+    {
+        sendPartition(stream, reducer);
+    }
+}
+
+static void postRowGroup(StreamState *stream, MapperInput *input, int start, int count, int buffer)
+{
+    // Function to post the receives of one group of rows straight into the mapper's blocks
+
+    MPI_Request *requests = &stream->requests[2 * stream->window + 2 * buffer];
+    MPI_Datatype typeA = createMatrixBlockType(input->blockA, count, stream->size);
+    MPI_Datatype typeB = createMatrixBlockType(input->blockB, count, stream->size);
+
+    MPI_Irecv(MATRIX_ROW(input->blockA, start), 1, typeA, 0, 2, MPI_COMM_WORLD, &requests[0]);
+    MPI_Irecv(MATRIX_ROW(input->blockB, start), 1, typeB, 0, 3, MPI_COMM_WORLD, &requests[1]);
+
+    MPI_Type_free(&typeA);
+    MPI_Type_free(&typeB);
+}
+
+static void waitRowGroup(StreamState *stream, int buffer)
+{
+    MPI_Request *requests = &stream->requests[2 * stream->window + 2 * buffer];
+    Phase previous = enterPhase(PHASE_DISPATCH);
+    while (requests[0] != MPI_REQUEST_NULL || requests[1] != MPI_REQUEST_NULL)
+    {
+        streamProgress(stream, 1);
+    }
+    enterPhase(previous);
+}
+
+//--------------------------------------------------------------------//
+
+void processTaskMapStream(int rank, int size, int Mappers, int *reducerRanks, int Reducers, const JobOptions *options, MapperInput *input, ReducerOutput *output)
+{
+    // Function to map, shuffle and reduce in one streaming pass, called by every mapper
+    // Inputs:
+    // - rank: rank of the current process, a mapper
+    // - size: size of the matrices
+    // - Mappers: total number of mappers, each sends one partial sum per key in outer product mode
+    // - reducerRanks, Reducers: reducer layout, decides where each key goes
+    // - options: job options, map mode, batch size and stream window
+    // - input: the mapper's rows, or empty when they are streamed from the master
+    // - output: receives the reduced cells when this mapper is also a reducer
+
+    char *machineName = malloc(MPI_MAX_PROCESSOR_NAME * sizeof(char));
+    int nameLength;
+    MPI_Get_processor_name(machineName, &nameLength);
+
+    StreamState stream;
+    stream.size = size;
+    stream.reducerRanks = reducerRanks;
+    stream.Reducers = Reducers;
+    stream.batchSize = resolveBatchSize(options, size);
+    stream.window = options->streamWindow;
+    stream.messagesSent = 0;
+    stream.waitTime = 0.0;
+
+    int totalRequests = 2 * stream.window + STREAM_INPUT_REQUESTS;
+    stream.requests = (MPI_Request *)malloc(totalRequests * sizeof(MPI_Request));
+    stream.completed = (int *)malloc(totalRequests * sizeof(int));
+    stream.statuses = (MPI_Status *)malloc(totalRequests * sizeof(MPI_Status));
+    for (int r = 0; r < totalRequests; r++)
+    {
+        stream.requests[r] = MPI_REQUEST_NULL;
+    }
+
+    stream.partitions = (PairBatch *)malloc(Reducers * sizeof(PairBatch));
+    for (int r = 0; r < Reducers; r++)
+    {
+        initPairBatch(&stream.partitions[r], stream.batchSize);
+    }
+    stream.sendBuffers = (char **)malloc(stream.window * sizeof(char *));
+    stream.receiveBuffers = (char **)malloc(stream.window * sizeof(char *));
+    for (int s = 0; s < stream.window; s++)
+    {
+        stream.sendBuffers[s] = (char *)malloc(stream.batchSize * STREAM_PAIR_BYTES);
+        stream.receiveBuffers[s] = NULL;
+    }
+
+    // -----------------------
+    // Reducer Role
+    // -----------------------
+
+    stream.output = output;
+    stream.valuesPerKey = options->mapMode == MAP_OUTER ? Mappers : 2 * size;
+    stream.arrived = NULL;
+    stream.rowValues = NULL;
+    stream.columnValues = NULL;
+    stream.present = NULL;
+    stream.pendingPairs = 0;
+    stream.sparse = options->sparse;
+    stream.pendingMappers = 0;
+    stream.pairsSent = (long long *)calloc(Reducers, sizeof(long long));
+
+    for (int reducer = 0; reducer < Reducers; reducer++)
+    {
+        if (reducerRanks[reducer] == rank)
+        {
+            printf("Process %d received task reduce on %s.\n", rank, machineName);
+            initReducerOutput(output, reducer, Reducers, size);
+            memset(output->values, 0, output->numKeys * sizeof(int));
+
+            stream.arrived = (int *)calloc(output->numKeys + 1, sizeof(int));
+            if (options->mapMode == MAP_ROW)
+            {
+                stream.rowValues = (int *)calloc((size_t)output->numKeys * size + 1, sizeof(int));
+                stream.columnValues = (int *)calloc((size_t)output->numKeys * size + 1, sizeof(int));
+                stream.present = (unsigned char *)calloc(2 * (size_t)output->numKeys * size + 1, 1);
+                // Zeroed, a sparse mapper never sends the zero elements
+            }
+            stream.pendingPairs = stream.sparse ? 0 : (long long)output->numKeys * stream.valuesPerKey;
+            stream.pendingMappers = Mappers;
+
+            for (int s = 0; s < stream.window; s++)
+            {
+                stream.receiveBuffers[s] = (char *)malloc(stream.batchSize * STREAM_PAIR_BYTES);
+                postPairReceive(&stream, s);
+            }
+            // Receives stay posted from the start, so mappers never wait for this rank to get here
+        }
+    }
+
+    // -----------------------
+    // Mapper Role
+    // -----------------------
+
+    int streamed = streamsInputRows(options);
+    int group = rankThreadCount();
+
+    if (streamed)
+    {
+        int header[3];
+        MPI_Recv(header, 3, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        input->firstRow = header[0];
+        input->rows = header[1];
+        group = header[2];
+        input->blockA = allocateMatrix(input->rows, size);
+        input->blockB = allocateMatrix(input->rows, size);
+        // The rows come in groups of header[2], the master decides the grouping
+
+        for (int buffer = 0; buffer < 2 && buffer * group < input->rows; buffer++)
+        {
+            int start = buffer * group;
+            postRowGroup(&stream, input, start, input->rows - start < group ? input->rows - start : group, buffer);
+        }
+        // Two groups in flight: the next one arrives while the current one is mapped
+    }
+
+    printReceivedTask(rank, machineName);
+
+    if (options->mapMode == MAP_OUTER)
+    {
+        awaitRows(input, input->rows);
+        Matrix *partial = allocateMatrix(size, size);
+        combineOuterProducts(input->blockA, input->blockB, partial);
+        emitPartialSums(size, rank, partial, options->sparse, emitToStream, &stream);
+        freeMatrix(partial);
+    }
+    else
+    {
+        PairBatch *slices = (PairBatch *)malloc(group * sizeof(PairBatch));
+        for (int g = 0; g < group; g++)
+        {
+            initPairBatch(&slices[g], size * size * 2);
+        }
+
+        for (int ind = 0, buffer = 0; ind < input->rows; ind += group, buffer ^= 1)
+        {
+            int count = input->rows - ind < group ? input->rows - ind : group;
+
+            if (streamed)
+            {
+                waitRowGroup(&stream, buffer);
+            }
+            awaitRows(input, ind + count);
+
+            mapRowGroup(size, input->firstRow, ind, count, input->blockA, input->blockB, options->sparse, slices);
+
+            int next = ind + 2 * group;
+            if (streamed && next < input->rows)
+            {
+                postRowGroup(&stream, input, next, input->rows - next < group ? input->rows - next : group, buffer);
+            }
+            // The rows of this group are mapped, their buffer can take the group after the next
+
+            for (int g = 0; g < count; g++)
+            {
+                for (int p = 0; p < slices[g].count; p++)
+                {
+                    emitToStream(&stream, &slices[g].keys[p], &slices[g].values[p]);
+                }
+            }
+            // Full batches leave while the rest of the block is still being mapped
+
+            streamProgress(&stream, 0);
+        }
+
+        for (int g = 0; g < group; g++)
+        {
+            freePairBatch(&slices[g]);
+        }
+        free(slices);
+    }
+
+    if (options->verify == VERIFY_EXACT)
+    {
+        freeMapperInput(input);   // the Freivalds check reads the rows again once the result is out
+    }
+
+    for (int r = 0; r < Reducers; r++)
+    {
+        sendPartition(&stream, r);
+        if (stream.sparse)
+        {
+            sendClosing(&stream, r);
+        }
+    }
+    // Send the last partial batch of every reducer, and a sparse mapper's pair counts
+
+    printCompletedTask(rank, machineName);
+
+    // -----------------------
+    // Drain
+    // -----------------------
+
+    enterPhase(PHASE_SHUFFLE);
+    int sending = 1;
+    while (stillReceiving(&stream) || sending)
+    {
+        sending = 0;
+        for (int s = 0; s < stream.window; s++)
+        {
+            sending |= stream.requests[stream.window + s] != MPI_REQUEST_NULL;
+        }
+        if (stillReceiving(&stream) || sending)
+        {
+            streamProgress(&stream, 1);
+        }
+    }
+    // Keys were reduced as they completed, only the last messages are left to finish
+
+    for (int q = 0; stream.sparse && stream.rowValues != NULL && q < output->numKeys; q++)
+    {
+        if (stream.arrived[q] > 0 && stream.arrived[q] < stream.valuesPerKey)
+        {
+            output->values[q] = dotProduct(size, &stream.rowValues[(size_t)q * size], &stream.columnValues[(size_t)q * size]);
+        }
+    }
+    // Sparse keys that never got all 2 * size values, the missing ones are zeros; duplicates were rejected on arrival
+
+    for (int s = 0; s < stream.window; s++)
+    {
+        if (stream.requests[s] != MPI_REQUEST_NULL)
+        {
+            MPI_Cancel(&stream.requests[s]);
+            MPI_Wait(&stream.requests[s], MPI_STATUS_IGNORE);
+        }
+        free(stream.receiveBuffers[s]);
+        free(stream.sendBuffers[s]);
+    }
+    // Every pair has arrived, nothing will match the receives still posted
+
+    if (stream.arrived != NULL)
+    {
+        printf("\nProcess %d has completed Reduce map on %s.\n", rank, machineName);
+    }
+    printf("Process %d sent %lld stream messages and waited %f seconds on communication.\n", rank, stream.messagesSent, stream.waitTime);
+
+    for (int r = 0; r < Reducers; r++)
+    {
+        freePairBatch(&stream.partitions[r]);
+    }
+    free(stream.partitions);
+    free(stream.sendBuffers);
+    free(stream.receiveBuffers);
+    free(stream.requests);
+    free(stream.completed);
+    free(stream.statuses);
+    free(stream.arrived);
+    free(stream.rowValues);
+    free(stream.columnValues);
+    free(stream.present);
+    free(stream.pairsSent);
+    free(machineName);
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
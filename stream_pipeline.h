@@ -0,0 +1,57 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef STREAM_PIPELINE_H
+#define STREAM_PIPELINE_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+#define STREAM_INPUT_REQUESTS 4     // two row groups in flight, one message per matrix each
+
+typedef struct {
+    int size;
+    int* reducerRanks;
+    int Reducers;
+    int batchSize;          // pairs per message
+    int window;             // sends, and receives, kept in flight
+
+    PairBatch* partitions;  // pairs waiting to go out, one per reducer
+    char** sendBuffers;     // keys of a batch followed by its values, one per send slot
+    char** receiveBuffers;  // one per receive slot
+    MPI_Request* requests;  // receive slots, then send slots, then the incoming row groups
+    int* completed;
+    MPI_Status* statuses;
+
+    ReducerOutput* output;  // this rank's key range, numKeys is 0 when it does not reduce
+    int valuesPerKey;       // 2 * size in row mode, one partial sum per mapper in outer mode
+    int* arrived;           // values received so far for every key of the range
+    int* rowValues;         // row mode: A[i][j] of key q is at q * size + j
+    int* columnValues;      // row mode: B[j][k] of key q is at q * size + j
+    unsigned char* present; // row mode: whether A[i][j] and B[j][k] of key q arrived, at 2 * (q * size + j) and the byte after
+    long long pendingPairs; // pairs still to arrive for this rank's keys
+    int sparse;             // mappers leave out zero elements, so the pairs of a key cannot be counted
+    int pendingMappers;     // sparse: mappers whose closing message has not arrived yet
+    long long* pairsSent;   // sparse: pairs this mapper sent to every reducer, announced when it closes
+
+    long long messagesSent;
+    double waitTime;
+} StreamState;
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+int streamsInputRows(const JobOptions* options);
+void streamRowsToMappers(int Mappers, int size, const Matrix* matrix1, const Matrix* matrix2, int groupRows, int window);
+void processTaskMapStream(int rank, int size, int Mappers, int* reducerRanks, int Reducers, const JobOptions* options, MapperInput* input, ReducerOutput* output);
+
+
+#endif
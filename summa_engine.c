@@ -0,0 +1,267 @@
+#include "summa_engine.h"
+#include "gemm_kernel.h"
+#include "matrix_mpiio.h"
+#include "phase_timer.h"
+#include "result_verify.h"
+
+//----------------------------------------------------------    SUMMA Engine    ----------------------------------------------------------//
+
+// Scalable Universal Matrix Multiplication Algorithm on a 2D process grid.
+// Rank (r, c) of a pr x pc grid owns block (r, c) of A, B and C, with block edges from
+// blockStart/blockLength. For every panel of inner indices the owner column broadcasts its
+// slice of A along the grid row, the owner row broadcasts its slice of B down the grid
+// column, and every rank adds the panel product into its C block with the local GEMM kernel.
+
+static void gridBlock(MPI_Comm grid, int rank, int size, int *dims, int *rowStart, int *rows, int *colStart, int *cols)
+{
+    int coords[2];
+    MPI_Cart_coords(grid, rank, 2, coords);
+    *rowStart = blockStart(coords[0], dims[0], size);
+    *rows = blockLength(coords[0], dims[0], size);
+    *colStart = blockStart(coords[1], dims[1], size);
+    *cols = blockLength(coords[1], dims[1], size);
+}
+
+//--------------------------------------------------------------------//
+
+static void distributeBlocks(int rank, int numOfProcesses, MPI_Comm grid, int *dims, char *inputFile1, char *inputFile2, int size, InputMode input, int *localA, int *localB)
+{
+    // Function to hand every rank its block of A and B
+    // Inputs:
+    // - grid: the 2D process grid
+    // - dims: grid dimensions
+    // - input: INPUT_MASTER has the master read and send the blocks, otherwise every rank reads its own
+    //   (grid blocks are never shared between ranks, so INPUT_SHARED and INPUT_RMA read them like INPUT_COLLECTIVE)
+    // - localA, localB: receive this rank's blocks
+
+    int rowStart, rows, colStart, cols;
+
+    if (input != INPUT_MASTER)
+    {
+        enterPhase(PHASE_READ);
+        gridBlock(grid, rank, size, dims, &rowStart, &rows, &colStart, &cols);
+        Matrix *blockA = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile1, size, rowStart, rows, colStart, cols);
+        Matrix *blockB = readMatrixBlockCollective(MPI_COMM_WORLD, inputFile2, size, rowStart, rows, colStart, cols);
+        packMatrixBlock(blockA, 0, rows, 0, cols, localA);
+        packMatrixBlock(blockB, 0, rows, 0, cols, localB);
+        freeMatrix(blockA);
+        freeMatrix(blockB);
+
+        for (int dest = 1; rank == 0 && dest < numOfProcesses; dest++)
+        {
+            printf("Task SUMMA Assigned to process %d.\n", dest);
+        }
+    }
+    else if (rank == 0)
+    {
+        Matrix *matrix1;
+        Matrix *matrix2;
+        enterPhase(PHASE_READ);
+        populateMatricesFromFile(inputFile1, inputFile2, size, &matrix1, &matrix2);
+
+        enterPhase(PHASE_DISPATCH);
+        for (int dest = 1; dest < numOfProcesses; dest++)
+        {
+            gridBlock(grid, dest, size, dims, &rowStart, &rows, &colStart, &cols);
+            MPI_Datatype blockType1 = createMatrixBlockType(matrix1, rows, cols);
+            MPI_Datatype blockType2 = createMatrixBlockType(matrix2, rows, cols);
+            MPI_Send(&MATRIX_AT(matrix1, rowStart, colStart), 1, blockType1, dest, 40, MPI_COMM_WORLD);
+            MPI_Send(&MATRIX_AT(matrix2, rowStart, colStart), 1, blockType2, dest, 41, MPI_COMM_WORLD);
+            MPI_Type_free(&blockType1);
+            MPI_Type_free(&blockType2);
+            printf("Task SUMMA Assigned to process %d.\n", dest);
+        }
+        // Blocks are sent straight out of the matrices and arrive packed
+
+        gridBlock(grid, 0, size, dims, &rowStart, &rows, &colStart, &cols);
+        packMatrixBlock(matrix1, rowStart, rows, colStart, cols, localA);
+        packMatrixBlock(matrix2, rowStart, rows, colStart, cols, localB);
+
+        freeMatrix(matrix1);
+        freeMatrix(matrix2);
+    }
+    else
+    {
+        enterPhase(PHASE_DISPATCH);
+        gridBlock(grid, rank, size, dims, &rowStart, &rows, &colStart, &cols);
+        MPI_Recv(localA, rows * cols, MPI_INT, 0, 40, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(localB, rows * cols, MPI_INT, 0, 41, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+}
+
+//--------------------------------------------------------------------//
+
+static void gatherBlocks(int rank, int numOfProcesses, MPI_Comm grid, int *dims, int size, const int *localC, Matrix *result)
+{
+    // Function to collect every rank's C block into the master's result matrix
+
+    int rowStart, rows, colStart, cols;
+
+    if (rank == 0)
+    {
+        gridBlock(grid, 0, size, dims, &rowStart, &rows, &colStart, &cols);
+        unpackMatrixBlock(result, localC, rowStart, rows, colStart, cols);
+
+        for (int source = 1; source < numOfProcesses; source++)
+        {
+            gridBlock(grid, source, size, dims, &rowStart, &rows, &colStart, &cols);
+            MPI_Datatype blockType = createMatrixBlockType(result, rows, cols);
+            MPI_Recv(&MATRIX_AT(result, rowStart, colStart), 1, blockType, source, 42, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Type_free(&blockType);
+            // Received straight into place in the result
+        }
+    }
+    else
+    {
+        gridBlock(grid, rank, size, dims, &rowStart, &rows, &colStart, &cols);
+        MPI_Send(localC, rows * cols, MPI_INT, 0, 42, MPI_COMM_WORLD);
+    }
+}
+
+//--------------------------------------------------------------------//
+
+void runSummaEngine(int rank, int numOfProcesses, char *inputFile1, char *inputFile2, int size, const JobOptions *options)
+{
+    // Function to multiply the input matrices with SUMMA and write Output.txt on the master
+    // Inputs:
+    // - rank: rank of the current process
+    // - numOfProcesses: number of processes, all of them join the grid
+    // - inputFile1, inputFile2: input matrix files, read by the master
+    // - size: size of the matrices
+    // - options: job options, panelWidth sets how many inner indices go into one broadcast
+
+    int dims[2] = {0, 0};
+    int periods[2] = {0, 0};
+    MPI_Dims_create(numOfProcesses, 2, dims);
+
+    MPI_Comm grid;
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+    // No reordering, so a rank's grid rank is its world rank
+
+    int coords[2];
+    MPI_Cart_coords(grid, rank, 2, coords);
+
+    MPI_Comm rowComm, colComm;
+    int keepColumns[2] = {0, 1};
+    int keepRows[2] = {1, 0};
+    MPI_Cart_sub(grid, keepColumns, &rowComm);
+    MPI_Cart_sub(grid, keepRows, &colComm);
+    // rowComm spans one grid row (rank = grid column), colComm one grid column (rank = grid row)
+
+    char machineName[MPI_MAX_PROCESSOR_NAME];
+    int nameLength;
+    MPI_Get_processor_name(machineName, &nameLength);
+    if (rank == 0)
+    {
+        printMasterDetails(rank, machineName);
+        printf("SUMMA process grid: %d x %d, panel width %d, local kernel %s\n", dims[0], dims[1], options->panelWidth, gemmKernelName());
+    }
+
+    int rowStart, rows, colStart, cols;
+    gridBlock(grid, rank, size, dims, &rowStart, &rows, &colStart, &cols);
+
+    int *localA = (int *)malloc(((size_t)rows * cols + 1) * sizeof(int));
+    int *localB = (int *)malloc(((size_t)rows * cols + 1) * sizeof(int));
+    int *localC = (int *)calloc((size_t)rows * cols + 1, sizeof(int));
+    int *panelA = (int *)malloc(((size_t)rows * options->panelWidth + 1) * sizeof(int));
+    int *panelB = (int *)malloc(((size_t)options->panelWidth * cols + 1) * sizeof(int));
+
+    distributeBlocks(rank, numOfProcesses, grid, dims, inputFile1, inputFile2, size, options->input, localA, localB);
+
+    double multiplyStart = MPI_Wtime();
+
+    for (int k = 0; k < size;)
+    {
+        int ownerCol = blockOwner(k, dims[1], size);
+        int ownerRow = blockOwner(k, dims[0], size);
+        int width = options->panelWidth;
+        int aEnd = blockStart(ownerCol, dims[1], size) + blockLength(ownerCol, dims[1], size);
+        int bEnd = blockStart(ownerRow, dims[0], size) + blockLength(ownerRow, dims[0], size);
+        if (width > aEnd - k)
+        {
+            width = aEnd - k;
+        }
+        if (width > bEnd - k)
+        {
+            width = bEnd - k;
+        }
+        // A panel never crosses a block edge, so a single rank owns each slice
+
+        enterPhase(PHASE_SHUFFLE);
+        if (coords[1] == ownerCol)
+        {
+            for (int row = 0; row < rows; row++)
+            {
+                memcpy(&panelA[(size_t)row * width], &localA[(size_t)row * cols + (k - colStart)], width * sizeof(int));
+            }
+        }
+        MPI_Bcast(panelA, rows * width, MPI_INT, ownerCol, rowComm);
+        // Columns k .. k + width of this grid row's A blocks
+
+        if (coords[0] == ownerRow)
+        {
+            memcpy(panelB, &localB[(size_t)(k - rowStart) * cols], (size_t)width * cols * sizeof(int));
+        }
+        MPI_Bcast(panelB, width * cols, MPI_INT, ownerRow, colComm);
+        // Rows k .. k + width of this grid column's B blocks
+
+        enterPhase(PHASE_MAP);
+        gemmAccumulate(rows, cols, width, panelA, width, panelB, cols, localC, cols);
+
+        k += width;
+    }
+
+    enterPhase(PHASE_NONE);
+    double multiplyTime = MPI_Wtime() - multiplyStart;
+    double slowest = 0.0;
+    MPI_Reduce(&multiplyTime, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    printf("Process %d has completed task SUMMA on %s.\n", rank, machineName);
+
+    if (options->output == OUTPUT_COLLECTIVE)
+    {
+        enterPhase(PHASE_WRITE);
+        writeMatrixBlockCollective(MPI_COMM_WORLD, outputFileName(options), size, options->outputFormat, rowStart, rows, colStart, cols, localC, cols);
+        // Every rank writes its C block into place, no gather on the master
+    }
+    else
+    {
+        enterPhase(PHASE_GATHER);
+        Matrix *result = NULL;
+        if (rank == 0)
+        {
+            result = allocateMatrix(size, size);
+        }
+        gatherBlocks(rank, numOfProcesses, grid, dims, size, localC, result);
+        enterPhase(PHASE_NONE);
+        if (rank == 0)
+        {
+            writeOutputMatrix(result, options);
+            freeMatrix(result);
+        }
+    }
+
+    if (rank == 0)
+    {
+        printf("SUMMA multiply time: %f seconds\n", slowest);
+        printf("\nJob has been Completed");
+    }
+
+    MatrixPiece pieceA = matrixPiece(rowStart, rows, colStart, cols, localA, cols);
+    MatrixPiece pieceB = matrixPiece(rowStart, rows, colStart, cols, localB, cols);
+    MatrixPiece pieceC = matrixPiece(rowStart, rows, colStart, cols, localC, cols);
+    verifyJobResult(rank, inputFile1, inputFile2, size, options, &pieceA, 1, &pieceB, 1, &pieceC, 1);
+    // Every rank checks with the blocks of A, B and C it multiplied
+
+    free(localA);
+    free(localB);
+    free(localC);
+    free(panelA);
+    free(panelB);
+    MPI_Comm_free(&rowComm);
+    MPI_Comm_free(&colComm);
+    MPI_Comm_free(&grid);
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
@@ -0,0 +1,19 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef SUMMA_ENGINE_H
+#define SUMMA_ENGINE_H
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+void runSummaEngine(int rank, int numOfProcesses, char* inputFile1, char* inputFile2, int size, const JobOptions* options);
+
+
+#endif
@@ -0,0 +1,526 @@
+#include "task_scheduler.h"
+#include "intermediate_store.h"
+#include "matrix_mpiio.h"
+#include "rma_input.h"
+#include "phase_timer.h"
+#include "result_verify.h"
+
+#define TASK_REQUEST_TAG 70
+#define TASK_ASSIGN_TAG 71
+#define TASK_ROWS_A_TAG 72
+#define TASK_ROWS_B_TAG 73
+#define TASK_RESULT_TAG 74
+#define TASK_OFFSETS_TAG 75
+#define TASK_BUCKETS_TAG 76
+
+//----------------------------------------------------------    Dynamic Scheduler    ----------------------------------------------------------//
+
+// Pull-based master / worker scheduling. Every rank but the master is a worker that asks the
+// master for a task whenever it is idle; the request also carries the output of the task it
+// just finished. Map tasks are blocks of rows, so a fast node simply takes more of them.
+// Once every map task is back and grouped, the master hands out runs of output cells as
+// reduce tasks the same way. Workers asking for work while the last map tasks are still out
+// wait until the grouping is done. With --input=rma the master only names the rows of a map
+// task, the worker fetches them from the master's windows itself.
+
+static int resolveTaskRows(const JobOptions *options, int size, int workers)
+{
+    if (options->taskRows > 0)
+    {
+        return options->taskRows < size ? options->taskRows : size;
+    }
+    int rows = size / (4 * workers);
+    return rows > 0 ? rows : 1;
+}
+
+static int resolveTaskKeys(const JobOptions *options, int size, int workers)
+{
+    if (options->taskKeys > 0)
+    {
+        return options->taskKeys;
+    }
+    int keys = size * size / (4 * workers);
+    return keys > 0 ? keys : 1;
+}
+
+//--------------------------------------------------------------------//
+
+static void sendMapTask(int worker, Task *task, int size, const Matrix *matrix1, const Matrix *matrix2, MapMode mapMode, int fetched)
+{
+    // Function to hand a worker a block of rows to map, 'fetched' leaves the rows for the worker to get
+
+    MPI_Send(task, 3, MPI_INT, worker, TASK_ASSIGN_TAG, MPI_COMM_WORLD);
+    printf("Task Map (rows %d-%d) Assigned to process %d.\n", task->first, task->first + task->count - 1, worker);
+    if (fetched)
+    {
+        return;
+    }
+
+    MPI_Datatype typeA = mapMode == MAP_OUTER ? createMatrixBlockType(matrix1, size, task->count) : createMatrixBlockType(matrix1, task->count, size);
+    MPI_Datatype typeB = createMatrixBlockType(matrix2, task->count, size);
+    const int *firstA = mapMode == MAP_OUTER ? &MATRIX_AT(matrix1, 0, task->first) : MATRIX_ROW(matrix1, task->first);
+
+    MPI_Send(firstA, 1, typeA, worker, TASK_ROWS_A_TAG, MPI_COMM_WORLD);
+    MPI_Send(MATRIX_ROW(matrix2, task->first), 1, typeB, worker, TASK_ROWS_B_TAG, MPI_COMM_WORLD);
+    // Outer product mode sends the same range of columns of matrix1 instead of its rows
+
+    MPI_Type_free(&typeA);
+    MPI_Type_free(&typeB);
+}
+
+static void sendReduceTask(int worker, Task *task, IntermediateStore *store)
+{
+    // Function to hand a worker a run of output cells with the values of every cell
+
+    MPI_Send(task, 3, MPI_INT, worker, TASK_ASSIGN_TAG, MPI_COMM_WORLD);
+
+    int *offsets = (int *)malloc((task->count + 1) * sizeof(int));
+    size_t capacity = 1024;
+    MatrixValue *buckets = (MatrixValue *)malloc(capacity * sizeof(MatrixValue));
+
+    offsets[0] = 0;
+    for (int q = 0; q < task->count; q++)
+    {
+        int keyIndex, count;
+        MatrixValue *bucket;
+        storeNextKey(store, &keyIndex, &bucket, &count);
+        // Reduce tasks are handed out in key order, the order the store returns the keys in
+
+        while ((size_t)(offsets[q] + count) > capacity)
+        {
+            capacity *= 2;
+            buckets = (MatrixValue *)realloc(buckets, capacity * sizeof(MatrixValue));
+        }
+        memcpy(&buckets[offsets[q]], bucket, count * sizeof(MatrixValue));
+        offsets[q + 1] = offsets[q] + count;
+    }
+
+    MPI_Send(offsets, task->count + 1, MPI_INT, worker, TASK_OFFSETS_TAG, MPI_COMM_WORLD);
+    MPI_Send(buckets, offsets[task->count] * sizeof(MatrixValue), MPI_BYTE, worker, TASK_BUCKETS_TAG, MPI_COMM_WORLD);
+    // The buckets of all cells of the task go out back to back, offsets[q] is where cell q starts
+
+    free(offsets);
+    free(buckets);
+
+    printf("Task Reduce (cells %d-%d) Assigned to process %d.\n", task->first, task->first + task->count - 1, worker);
+}
+
+static void printWorkerSummary(const WorkerSummary *summaries, int workers)
+{
+    printf("\nWorker  Map tasks      Rows  Reduce tasks      Cells  Busy (s)    Rows/s   Cells/s\n");
+    for (int w = 0; w < workers; w++)
+    {
+        const WorkerSummary *s = &summaries[w];
+        double rowRate = s->mapSeconds > 0 ? s->rows / s->mapSeconds : 0.0;
+        double cellRate = s->reduceSeconds > 0 ? s->keys / s->reduceSeconds : 0.0;
+        printf("%6d  %9d  %8lld  %12d  %9lld  %8.4f  %8.1f  %8.1f\n", w + 1, s->mapTasks, s->rows, s->reduceTasks, s->keys,
+               s->mapSeconds + s->reduceSeconds, rowRate, cellRate);
+    }
+}
+
+//--------------------------------------------------------------------//
+
+static void scheduleTasks(int workers, int size, const JobOptions *options, const Matrix *matrix1, const Matrix *matrix2, int *cells)
+{
+    // Function to serve task requests on the master until every worker has been told to stop
+    // Inputs:
+    // - workers: number of workers, ranks 1 .. workers
+    // - size: size of the matrices
+    // - options: job options, map mode, task sizes and the intermediate store budget
+    // - matrix1, matrix2: the input matrices
+    // - cells: receives the size * size result cells in row-major order
+
+    int taskRows = resolveTaskRows(options, size, workers);
+    int taskKeys = resolveTaskKeys(options, size, workers);
+    printf("Dynamic schedule: %d rows per map task, %d cells per reduce task\n", taskRows, taskKeys);
+
+    IntermediateStore store;
+    initIntermediateStore(&store, size, options->memoryBudgetMB, options->scratchDir);
+    PairBatch incoming;
+    initPairBatch(&incoming, resolveBatchSize(options, size));
+
+    WorkerSummary *summaries = (WorkerSummary *)calloc(workers, sizeof(WorkerSummary));
+    int *waiting = (int *)malloc(workers * sizeof(int));
+    int numWaiting = 0;
+
+    int nextRow = 0;
+    int nextKey = 0;
+    int mapsOutstanding = 0;
+    int grouped = 0;
+    int stopped = 0;
+
+    while (stopped < workers)
+    {
+        TaskRequest request;
+        MPI_Status status;
+        MPI_Recv(&request, sizeof(TaskRequest), MPI_BYTE, MPI_ANY_SOURCE, TASK_REQUEST_TAG, MPI_COMM_WORLD, &status);
+        int worker = status.MPI_SOURCE;
+        WorkerSummary *summary = &summaries[worker - 1];
+
+        if (request.completed == TASK_MAP)
+        {
+            int received = 0;
+            while (received < request.count)
+            {
+                int count = receiveMapperData(worker, incoming.keys, incoming.values);
+                storeAppend(&store, incoming.keys, incoming.values, count);
+                received += count;
+            }
+            // The pairs of the finished map task follow the request in batches
+
+            summary->mapTasks++;
+            summary->rows += summary->current.count;
+            summary->mapSeconds += request.seconds;
+            mapsOutstanding--;
+            printf("Process %d has completed task map.\n", worker);
+        }
+        else if (request.completed == TASK_REDUCE)
+        {
+            MPI_Recv(&cells[summary->current.first], summary->current.count, MPI_INT, worker, TASK_RESULT_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // The cells of a reduce task are contiguous, they land straight in the result
+
+            summary->reduceTasks++;
+            summary->keys += summary->current.count;
+            summary->reduceSeconds += request.seconds;
+            printf("Process %d has completed task reduce.\n", worker);
+        }
+
+        waiting[numWaiting++] = worker;
+
+        if (nextRow == size && mapsOutstanding == 0 && !grouped)
+        {
+            storeFinish(&store);
+            printf("Grouping time: %f seconds\n", store.groupingTime);
+            grouped = 1;
+        }
+        // All map output is in, the reduce tasks can be handed out
+
+        while (numWaiting > 0 && (nextRow < size || grouped))
+        {
+            int idle = waiting[0];
+            memmove(waiting, waiting + 1, (numWaiting - 1) * sizeof(int));
+            numWaiting--;
+            // Serve the longest waiting worker first
+
+            Task *task = &summaries[idle - 1].current;
+            if (nextRow < size)
+            {
+                task->kind = TASK_MAP;
+                task->first = nextRow;
+                task->count = size - nextRow < taskRows ? size - nextRow : taskRows;
+                nextRow += task->count;
+                mapsOutstanding++;
+                Phase previous = enterPhase(PHASE_DISPATCH);
+                sendMapTask(idle, task, size, matrix1, matrix2, options->mapMode, options->input == INPUT_RMA);
+                enterPhase(previous);
+            }
+            else if (nextKey < size * size)
+            {
+                task->kind = TASK_REDUCE;
+                task->first = nextKey;
+                task->count = size * size - nextKey < taskKeys ? size * size - nextKey : taskKeys;
+                nextKey += task->count;
+                sendReduceTask(idle, task, &store);
+            }
+            else
+            {
+                task->kind = TASK_DONE;
+                task->first = 0;
+                task->count = 0;
+                MPI_Send(task, 3, MPI_INT, idle, TASK_ASSIGN_TAG, MPI_COMM_WORLD);
+                stopped++;
+            }
+        }
+        // Workers that ask while the last map tasks are still out wait here for the grouping
+    }
+
+    printWorkerSummary(summaries, workers);
+
+    free(summaries);
+    free(waiting);
+    freePairBatch(&incoming);
+    freeIntermediateStore(&store);
+}
+
+//--------------------------------------------------------------------//
+
+static void emitToTask(void *context, const MatrixKey *key, const MatrixValue *value)
+{
+    appendPair((PairBatch *)context, key, value);
+}
+
+static void mapTask(const Task *task, int size, const JobOptions *options, const RmaInput *rma, PairBatch *pairs)
+{
+    // Function to receive (or fetch, when 'rma' is set) the rows of a map task and map them into 'pairs'
+
+    int group = rankThreadCount();
+    MapperInput input = {task->first, task->count, NULL, NULL, NULL};
+    if (rma != NULL)
+    {
+        enterPhase(PHASE_READ);
+        fetchRowsRma(rma, size, options->mapMode, task->first, task->count, group, &input);
+        // The first two groups are requested at once, later ones as the earlier ones arrive
+    }
+    else
+    {
+        enterPhase(PHASE_DISPATCH);
+        input.blockA = options->mapMode == MAP_OUTER ? allocateMatrix(size, task->count) : allocateMatrix(task->count, size);
+        input.blockB = allocateMatrix(task->count, size);
+        MPI_Datatype typeA = createMatrixBlockType(input.blockA, input.blockA->rows, input.blockA->cols);
+        MPI_Datatype typeB = createMatrixBlockType(input.blockB, input.blockB->rows, input.blockB->cols);
+        MPI_Recv(input.blockA->data, 1, typeA, 0, TASK_ROWS_A_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(input.blockB->data, 1, typeB, 0, TASK_ROWS_B_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Type_free(&typeA);
+        MPI_Type_free(&typeB);
+    }
+    Matrix *blockA = input.blockA;
+    Matrix *blockB = input.blockB;
+
+    enterPhase(PHASE_MAP);
+    pairs->count = 0;
+
+    if (options->mapMode == MAP_OUTER)
+    {
+        awaitRows(&input, task->count);
+        Matrix *partial = allocateMatrix(size, size);
+        combineOuterProducts(blockA, blockB, partial);
+        emitPartialSums(size, task->first, partial, options->sparse, emitToTask, pairs);
+        freeMatrix(partial);
+        // The first row identifies the task's partial sums, so each stays distinct
+    }
+    else
+    {
+        PairBatch *slices = (PairBatch *)malloc(group * sizeof(PairBatch));
+        for (int g = 0; g < group; g++)
+        {
+            initPairBatch(&slices[g], size * size * 2);
+        }
+
+        for (int ind = 0; ind < task->count; ind += group)
+        {
+            int count = task->count - ind < group ? task->count - ind : group;
+            awaitRows(&input, ind + count);
+            mapRowGroup(size, task->first, ind, count, blockA, blockB, options->sparse, slices);
+            for (int g = 0; g < count; g++)
+            {
+                for (int p = 0; p < slices[g].count; p++)
+                {
+                    appendPair(pairs, &slices[g].keys[p], &slices[g].values[p]);
+                }
+            }
+        }
+
+        for (int g = 0; g < group; g++)
+        {
+            freePairBatch(&slices[g]);
+        }
+        free(slices);
+    }
+
+    freeMapperInput(&input);
+}
+
+static void reduceTask(const Task *task, int size, int sparse, char *scratch, int *results)
+{
+    // Function to receive the values of a reduce task and reduce every cell of it
+
+    enterPhase(PHASE_SHUFFLE);
+    int *offsets = (int *)malloc((task->count + 1) * sizeof(int));
+    MPI_Recv(offsets, task->count + 1, MPI_INT, 0, TASK_OFFSETS_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    MatrixValue *buckets = (MatrixValue *)malloc((offsets[task->count] + 1) * sizeof(MatrixValue));
+    MPI_Recv(buckets, offsets[task->count] * sizeof(MatrixValue), MPI_BYTE, 0, TASK_BUCKETS_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    enterPhase(PHASE_REDUCE);
+    int faults = 0;
+    #pragma omp parallel for schedule(static) reduction(+ : faults)
+    for (int q = 0; q < task->count; q++)
+    {
+        if (reduceKeyValues(&buckets[offsets[q]], offsets[q + 1] - offsets[q], size, sparse, scratch + rankThreadIndex() * REDUCE_SCRATCH_BYTES(size),
+                            &results[q]) != 0)
+        {
+            printf("Error: Output cell (%d, %d) has missing or duplicate values\n", (task->first + q) / size, (task->first + q) % size);
+            faults++;
+        }
+    }
+
+    free(offsets);
+    free(buckets);
+    if (faults > 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        // The master is waiting for this task's cells, exiting alone would leave it blocked
+    }
+}
+
+static void runWorker(int rank, int size, const JobOptions *options, const RmaInput *rma)
+{
+    // Function to ask the master for tasks and work on them until it says there is nothing left
+    // 'rma' holds the master's windows with --input=rma, NULL when the master sends the rows
+
+    char *machineName = malloc(MPI_MAX_PROCESSOR_NAME * sizeof(char));
+    int nameLength;
+    MPI_Get_processor_name(machineName, &nameLength);
+
+    int batchSize = resolveBatchSize(options, size);
+    PairBatch pairs;
+    initPairBatch(&pairs, 0);
+    int *results = NULL;
+    char *scratch = (char *)malloc(rankThreadCount() * REDUCE_SCRATCH_BYTES(size));   // per-thread working memory of every reduce task
+
+    TaskRequest request = {TASK_NONE, 0, 0.0};
+    Task task;
+
+    while (1)
+    {
+        MPI_Send(&request, sizeof(TaskRequest), MPI_BYTE, 0, TASK_REQUEST_TAG, MPI_COMM_WORLD);
+
+        if (request.completed == TASK_MAP)
+        {
+            for (int sent = 0; sent < pairs.count; sent += batchSize)
+            {
+                int count = pairs.count - sent < batchSize ? pairs.count - sent : batchSize;
+                sendMapperData(&pairs.keys[sent], &pairs.values[sent], count);
+            }
+        }
+        else if (request.completed == TASK_REDUCE)
+        {
+            enterPhase(PHASE_GATHER);
+            MPI_Send(results, task.count, MPI_INT, 0, TASK_RESULT_TAG, MPI_COMM_WORLD);
+        }
+        // The output of the finished task follows its request
+
+        enterPhase(PHASE_NONE);
+        MPI_Recv(&task, 3, MPI_INT, 0, TASK_ASSIGN_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (task.kind == TASK_DONE)
+        {
+            break;
+        }
+
+        double start = MPI_Wtime();
+        if (task.kind == TASK_MAP)
+        {
+            printf("Process %d received task map on %s.\n", rank, machineName);
+            mapTask(&task, size, options, rma, &pairs);
+            request.count = pairs.count;
+        }
+        else
+        {
+            printf("Process %d received task reduce on %s.\n", rank, machineName);
+            results = (int *)realloc(results, task.count * sizeof(int));
+            reduceTask(&task, size, options->sparse, scratch, results);
+            request.count = task.count;
+        }
+        request.completed = task.kind;
+        request.seconds = MPI_Wtime() - start;
+    }
+
+    freePairBatch(&pairs);
+    free(results);
+    free(scratch);
+    free(machineName);
+}
+
+//--------------------------------------------------------------------//
+
+int runDynamicSchedule(int rank, int numOfProcesses, char *inputFile1, char *inputFile2, int size, const JobOptions *options)
+{
+    // Function to run the whole job with pull-based scheduling, called by all ranks
+    // Inputs:
+    // - rank: current process rank, rank 0 schedules and every other rank works
+    // - numOfProcesses: total number of processes
+    // - inputFile1, inputFile2: the input files, read by the master
+    // - size: size of the matrices
+    // - options: job options
+    // Returns 0, or -1 on every rank when there is no worker
+
+    if (numOfProcesses < 2)
+    {
+        if (rank == 0)
+        {
+            printf("Error: The dynamic schedule needs at least one worker besides the master.\n");
+        }
+        return -1;
+    }
+
+    int *cells = NULL;
+    Matrix *matrix1 = NULL;
+    Matrix *matrix2 = NULL;
+    char *machineName = NULL;
+
+    if (rank == 0)
+    {
+        machineName = malloc(sizeof(char) * MPI_MAX_PROCESSOR_NAME);
+        int l;
+        MPI_Get_processor_name(machineName, &l);
+        printMasterDetails(rank, machineName);
+
+        enterPhase(PHASE_READ);
+        populateMatricesFromFile(inputFile1, inputFile2, size, &matrix1, &matrix2);
+        // Tasks are cut from the whole matrices, so the master always reads the input
+    }
+
+    RmaInput rma = {MPI_WIN_NULL, MPI_WIN_NULL, 0, 0};
+    if (options->input == INPUT_RMA)
+    {
+        exposeInputMatrices(rank, matrix1, matrix2, &rma);
+    }
+    // Other input modes mean nothing here, the master sends the rows along with every task
+
+    if (rank == 0)
+    {
+        cells = (int *)malloc(((size_t)size * size + 1) * sizeof(int));
+        enterPhase(PHASE_SHUFFLE);
+        scheduleTasks(numOfProcesses - 1, size, options, matrix1, matrix2, cells);
+        printf("\nJob has been Completed");
+    }
+    else
+    {
+        runWorker(rank, size, options, options->input == INPUT_RMA ? &rma : NULL);
+    }
+
+    freeRmaInput(&rma);
+    // The windows are freed collectively, the master's matrices stay for the check
+
+    // -----------------------
+    // Write Output to File
+    // -----------------------
+
+    enterPhase(PHASE_WRITE);
+    if (options->output == OUTPUT_COLLECTIVE)
+    {
+        writeMatrixRangeCollective(MPI_COMM_WORLD, outputFileName(options), size, options->outputFormat,
+                                   0, rank == 0 ? size * size : 0, cells);
+        // The result is all on the master, the other ranks take part in the collective write with no cells
+    }
+    else if (rank == 0)
+    {
+        Matrix *result = allocateMatrix(size, size);
+        for (int row = 0; row < size; row++)
+        {
+            memcpy(MATRIX_ROW(result, row), &cells[(size_t)row * size], size * sizeof(int));
+        }
+        writeOutputMatrix(result, options);
+        freeMatrix(result);
+    }
+
+    // The master holds the whole input and result, so it checks alone, in O(size^2)
+
+    MatrixPiece pieceA, pieceB, piecesC[MAX_RESULT_PIECES];
+    int pieces = 0, resultPieces = 0;
+    if (rank == 0)
+    {
+        pieceA = matrixPiece(0, size, 0, size, matrix1->data, matrix1->stride);
+        pieceB = matrixPiece(0, size, 0, size, matrix2->data, matrix2->stride);
+        pieces = 1;
+        resultPieces = cellRangePieces(0, size * size, cells, size, piecesC);
+    }
+    verifyJobResult(rank, inputFile1, inputFile2, size, options, &pieceA, pieces, &pieceB, pieces, piecesC, resultPieces);
+
+    freeMasterResources(matrix1, matrix2, machineName);
+    free(cells);
+    return 0;
+}
+
+
+//-------------------------------------------------------------------ENd of Functions---------------------------------------------------//
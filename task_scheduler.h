@@ -0,0 +1,53 @@
+// ----------------------------------------------
+// Included Libraries and Header Guard Directive
+// ----------------------------------------------
+
+#include "matrix_operations.h"
+
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+
+// ---------------------------------
+// Struct Definitions
+// ---------------------------------
+
+typedef enum {
+    TASK_NONE,              // first request of a worker, nothing finished yet
+    TASK_MAP,               // map a block of rows (or columns of A in outer product mode)
+    TASK_REDUCE,            // reduce a run of output cells
+    TASK_DONE               // no work left, the worker stops asking
+} TaskKind;
+
+typedef struct {
+    int kind;               // TaskKind
+    int first;              // first row, or first key i * size + k
+    int count;              // rows or keys in the task
+} Task;
+
+typedef struct {
+    int completed;          // TaskKind of the task just finished
+    int count;              // pairs (map) or cells (reduce) that follow the request
+    double seconds;         // time the worker spent computing the finished task
+} TaskRequest;
+
+typedef struct {
+    Task current;           // task the worker is working on
+    int mapTasks;
+    long long rows;
+    int reduceTasks;
+    long long keys;
+    double mapSeconds;
+    double reduceSeconds;
+} WorkerSummary;
+
+
+// ---------------------------------
+// Function Declarations
+// ---------------------------------
+
+int runDynamicSchedule(int rank, int numOfProcesses, char* inputFile1, char* inputFile2, int size, const JobOptions* options);
+
+
+#endif